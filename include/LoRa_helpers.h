@@ -6,36 +6,201 @@
     @version 1.2 29/03/2021
 */
 
+/**
+    loraRxQueued() devuelve la cantidad de paquetes que esperan en loraRxQueue.
+    @return Slots ocupados (0 a LORA_RX_QUEUE_SLOTS).
+*/
+uint8_t loraRxQueued() {
+    return (loraRxHead + 2 * LORA_RX_QUEUE_SLOTS - loraRxTail) % (2 * LORA_RX_QUEUE_SLOTS);
+}
+
 /*
-    onRecieve() es la función por interrupción que se llama cuando
-    existen datos en el buffer LoRa.
+    onRecieve() es la función que se llama cuando existen datos en el buffer LoRa.
+    No corre dentro de la interrupción: la ISR de DIO0 sólo registra el evento y
+    LoRa.handleInterrupt(), llamada desde loop(), vacía el FIFO y llama a esta función.
+    El FIFO se lee al próximo slot libre de loraRxQueue; si la cola está llena, se descarta.
 */
 void onReceive(int packetSize) {
     // Si el tamaño del paquete entrante es nulo,
-    // o si es superior al tamaño reservado para la string incomingFull
+    // o si es superior al tamaño de un slot de la cola,
     // salir de la subrutina.
     if (packetSize == 0 || packetSize > INCOMING_FULL_MAX_SIZE) {
         return;
     }
 
-    // No se puede utilizar readString() en un callback.
-    // Se añaden los bytes uno por uno.
-    while (LoRa.available()) {
-        incomingFull += (char)LoRa.read();
+    if (loraRxQueued() == LORA_RX_QUEUE_SLOTS) {
+        loraRxOverflows++;
+        #if DEBUG_LEVEL >= 1
+            Serial.println("Cola RX LoRa llena!");
+        #endif
+        return;
+    }
+
+    // El FIFO se lee directamente al slot, en una sola ráfaga SPI.
+    uint8_t head = loraRxHead;
+    LoRaRxPacket& packet = loraRxQueue[head % LORA_RX_QUEUE_SLOTS];
+    packet.length = LoRa.readBytes(packet.data, INCOMING_FULL_MAX_SIZE);
+    packet.data[packet.length] = '\0';
+    packet.rssi = LoRa.packetRssi();
+    packet.snr = LoRa.packetSnr();
+    packet.timestamp = LoRa.interruptTime();
+
+    // Publica el slot recién completado.
+    loraRxHead = (head + 1) % (2 * LORA_RX_QUEUE_SLOTS);
+}
+
+/*
+    onTxDone() es la función que se llama (desde LoRa.handleInterrupt()) cuando el módulo
+    termina de transmitir un paquete (TX_DONE en DIO0).
+*/
+void onTxDone() {
+    loraTxState = LORA_TX_DONE;
+}
+
+/**
+    LoRaTransmit() transmite el paquete pendiente (outcomingFrame u outcomingFull, según
+    loraTxFrame) sin esperar el fin de la transmisión, y lo descuenta del ciclo de trabajo.
+    Antes atiende la interrupción pendiente: un paquete recibido debe salir del FIFO, que es
+    compartido con la transmisión, antes de que beginPacket() lo sobrescriba.
+*/
+void LoRaTransmit() {
+    LoRa.handleInterrupt();
+    if (!LoRa.beginPacket()) {
+        loraTxState = LORA_TX_IDLE;
+        LoRa.receive();
+        #if DEBUG_LEVEL >= 1
+            Serial.println("Módulo LoRa ocupado!");
+        #endif
+        return;
+    }
+    if (loraTxFrame) {
+        LoRa.write(outcomingFrame, outcomingFrameSize);
+    } else {
+        LoRa.print(outcomingFull);
+    }
+    loraTxState = LORA_TX_SENDING;
+    loraTxStart = millis();
+    LoRa.endPacket(true);
+    dutyCycleCharge(loraTxAirtime);
+}
+
+/**
+    LoRaListen() inicia una detección de actividad en el canal (CAD); el resultado llega a onCadDone().
+    Como LoRaTransmit(), antes atiende la interrupción pendiente: un paquete recibido se vacía
+    del FIFO en lugar de quedar detrás del CAD_DONE.
+*/
+void LoRaListen() {
+    LoRa.handleInterrupt();
+    LoRa.channelActivityDetection();
+    loraTxState = LORA_TX_CAD;
+    loraTxStart = millis();
+}
+
+/**
+    LoRaSend() inicia el envío del paquete pendiente: con LORA_LBT, primero escucha el canal.
+    Con las tramas TDMA sincronizadas el slot ya es exclusivo del nodo, y la espera aleatoria
+    (hasta LORA_LBT_SLOT * 2^LORA_LBT_ATTEMPTS ms) lo excedería: se transmite sin escuchar.
+    @param frame true para enviar outcomingFrame, false para enviar outcomingFull.
+    @param airtime Tiempo en el aire del paquete (en ms).
+*/
+void LoRaSend(bool frame, unsigned long airtime) {
+    loraTxFrame = frame;
+    loraTxAirtime = airtime;
+    loraLbtAttempts = 0;
+    #if LORA_LBT == TRUE
+        if (!tdmaSynced) {
+            LoRaListen();
+            return;
+        }
+    #endif
+    LoRaTransmit();
+}
+
+/*
+    onCadDone() es la función que se llama (desde LoRa.handleInterrupt()) cuando termina una
+    detección de actividad (CAD_DONE en DIO0; CAD_DETECTED se lee de los flags del módulo).
+    Si el canal está libre, transmite. Si no, espera lbtBackoff() en modo recepción y vuelve a
+    escuchar (ver lbt.h).
+*/
+void onCadDone(boolean detected) {
+    if (loraTxState != LORA_TX_CAD) {
+        return;
+    }
+    if (!lbtRetry(detected, loraLbtAttempts)) {
+        LoRaTransmit();
+        return;
     }
+    loraTxBackoff = lbtBackoff(++loraLbtAttempts);
+    loraTxState = LORA_TX_BACKOFF;
+    loraTxStart = millis();
+    LoRa.receive();
+    #if DEBUG_LEVEL >= 2
+        Serial.print("Canal LoRa ocupado, reintento en ");
+        Serial.print(loraTxBackoff);
+        Serial.println(" ms.");
+    #endif
+}
 
-    // Se levanta un flag de finalización de lectura LoRa.
-    incomingFullComplete = true;
+/**
+    LoRaTxObserver() completa la máquina de estados de la transmisión asincrónica:
+        - al vencer la espera aleatoria, vuelve a escuchar el canal,
+        - si CAD_DONE no llega en LORA_CAD_TIMEOUT ms, transmite de todos modos,
+        - cuando la interrupción informa TX_DONE, vuelve a poner al módulo en modo recepción.
+    Si TX_DONE no llega en LORA_TX_TIMEOUT segundos, fuerza el modo recepción de todos modos.
+*/
+void LoRaTxObserver() {
+    if (loraTxState == LORA_TX_BACKOFF && millis() - loraTxStart >= loraTxBackoff) {
+        LoRaListen();
+    } else if (loraTxState == LORA_TX_CAD && millis() - loraTxStart >= LORA_CAD_TIMEOUT) {
+        #if DEBUG_LEVEL >= 1
+            Serial.println("CAD LoRa sin CAD_DONE!");
+        #endif
+        LoRaTransmit();
+    } else if (loraTxState == LORA_TX_DONE) {
+        LoRa.receive();
+        loraTxState = LORA_TX_IDLE;
+        #if DEBUG_LEVEL >= 2
+            Serial.print("TX LoRa finalizada en ");
+            Serial.print(millis() - loraTxStart);
+            Serial.println(" ms.");
+        #endif
+    } else if (loraTxState == LORA_TX_SENDING && millis() - loraTxStart >= sec2ms(LORA_TX_TIMEOUT)) {
+        LoRa.idle();
+        LoRa.receive();
+        loraTxState = LORA_TX_IDLE;
+        #if DEBUG_LEVEL >= 1
+            Serial.println("TX LoRa sin TX_DONE!");
+        #endif
+    }
 }
 
+/**
+    downlinkObserver() procesa el paquete más antiguo de loraRxQueue (uno por pasada de loop(),
+    para que LoRaCmdObserver() atienda cada comando antes de recibir el siguiente). El mensaje se
+    interpreta en el propio slot, sin copiarlo: sólo el payload para este nodo pasa a
+    incomingPayload. Un paquete con un nulo antes de packet.length (binario o corrupto) o sin el
+    delimitador ">" no es un mensaje de texto y se descarta.
+*/
 void downlinkObserver() {
-    if (incomingFullComplete) {
+    if (loraRxQueued() > 0) {
+        uint8_t tail = loraRxTail;
+        const LoRaRxPacket& packet = loraRxQueue[tail % LORA_RX_QUEUE_SLOTS];
+        #if DEBUG_LEVEL >= 2
+            Serial.print("RX LoRa: RSSI=");
+            Serial.print(packet.rssi);
+            Serial.print(" SNR=");
+            Serial.print(packet.snr);
+            Serial.print(" t=");
+            Serial.print(packet.timestamp);
+            Serial.print(" descartados=");
+            Serial.println(loraRxOverflows);
+        #endif
+
         // Extraer el delimitador ">" para diferenciar el ID del payload.
-        int delimiter = incomingFull.indexOf(greaterSign);
+        const char* delimiter = (const char*)memchr(packet.data, '>', packet.length);
 
-        // Obtener el ID de receptor.
-        receiverStr = incomingFull.substring(1, delimiter);
-        int receiverID = receiverStr.toInt();
+        // Obtener el ID de receptor (atol() se detiene en el delimitador).
+        long receiverID = (delimiter != NULL && strlen(packet.data) == packet.length) ? atol(packet.data + 1) : -1;
         #if DEBUG_LEVEL >= 2
             Serial.print("Receiver: ");
             Serial.println(receiverID);
@@ -44,29 +209,35 @@ void downlinkObserver() {
         // Si el ID del receptor coincide con nuestro ID o si es un broadcast:
         if (receiverID == DEVICE_ID || receiverID == BROADCAST_ID) {
             // Obtiene el payload entrante.
-            // incomingFull típico del uplink LoRa:
+            // Mensaje típico del uplink LoRa:
             // <10009>daytime 
             // incomingPayload pasaría a ser:
             // daytime
-            incomingPayload = incomingFull.substring(delimiter + 1);
+            incomingPayload = delimiter + 1;
             #if DEBUG_LEVEL >= 2
                 Serial.println("ID coincide!");
             #endif
+
+            // Sólo el concentrador escribe a este nodo: el paquete mide la calidad del enlace.
+            adrObserve(packet.snr, packet.rssi);
+
+            // El beacon TDMA necesita el instante de recepción, por lo que se atiende aquí.
+            if (incomingPayload == knownCommands[4]) {              // knownCommands[4]: sync
+                tdmaBeacon(packet.timestamp, packet.length);
+                incomingPayload = "";
+            }
         } else if (receiverID == EXTERIOR_ID) {
-            // incomingFull típico del nodo exterior:
+            // Mensaje típico del nodo exterior (atof() se detiene en el "&" o la "/" siguiente):
             // <20009>current=0.65&raindrops=1&gas=123.51/150&lat=-34.57475&lng=58.43552&alt=15
-            equalsPosition = incomingFull.indexOf(equalSign);
-            ampersandPosition = incomingFull.indexOf(ampersandSign);
-            if (equalsPosition != -1 && ampersandPosition != -1) {
-                currentStr = incomingFull.substring(equalsPosition + 1, ampersandPosition);
-                currentBuffer = currentStr.toFloat();
+            const char* equals = strchr(delimiter, '=');
+            const char* ampersand = strchr(delimiter, '&');
+            if (equals != NULL && ampersand != NULL) {
+                currentBuffer = atof(equals + 1);
             }
-            ampersandPosition = incomingFull.indexOf(ampersandSign, ampersandPosition + 1);
-            equalsPosition = incomingFull.indexOf(equalSign, ampersandPosition);
-            slashPosition = incomingFull.indexOf(slashSign, equalsPosition);
-            if (equalsPosition != -1 && slashPosition != -1) {
-                gasStr = incomingFull.substring(equalsPosition + 1, slashPosition);
-                gasBuffer = gasStr.toFloat();
+            ampersand = (ampersand != NULL) ? strchr(ampersand + 1, '&') : NULL;
+            equals = (ampersand != NULL) ? strchr(ampersand, '=') : NULL;
+            if (equals != NULL && strchr(equals, '/') != NULL) {
+                gasBuffer = atof(equals + 1);
             }
             #if DEBUG_LEVEL >= 2
                 Serial.println("Nodo exterior!");
@@ -77,10 +248,8 @@ void downlinkObserver() {
             #endif
         }
 
-        // Limpiar variables.
-        incomingFullComplete = false;
-        incomingFull = "";
-        receiverStr = "";
+        // Liberar el slot.
+        loraRxTail = (tail + 1) % (2 * LORA_RX_QUEUE_SLOTS);
     }
 }
 
@@ -100,75 +269,43 @@ void LoRaInitialize() {
     }
     LoRa.setSyncWord(LORA_SYNC_WORD);
     LoRa.onReceive(onReceive);
+    LoRa.onTxDone(onTxDone);
+    LoRa.onCadDone(onCadDone);
+    adrApply();
     LoRa.receive();
 
+    // Las esperas aleatorias de listen-before-talk parten del ruido de RF (y del ID, por si
+    // dos nodos arrancan juntos).
+    randomSeed(((unsigned long)LoRa.random() << 8 | LoRa.random()) ^ DEVICE_ID);
+
     #if DEBUG_LEVEL >= 1
         Serial.println("LoRa initialized OK.");
     #endif
 }
 
-/**
-    composeLoRaPayload() se encarga de crear la string de carga útil de LoRa,
-    a partir de los estados actuales de los sensores.
-    Por ejemplo, si:
-        DEVICE_ID = 10009
-        volts = {220.00, 230.00}
-        temps = {24.00, 25.00}
-        status = "S"
-    Entonces, esta función sobreescribe la String a retornar con:
-        "<10009>voltage=225.00&temperature=24.50&status=S"
-    @param volts Array con los valores de medición de tensión.
-    @param temps Array con los valores de medición de temperatura.
-    @param status Estado de la cabina.
-    @param &rtn Dirección de memoria de la String a componer.
-*/
-void composeLoRaPayload(float volts[], float temps[], bool emergency, String status, String& rtn) {
-    // Payload LoRA = vector de bytes transmitidos en forma FIFO.
-    // | Dev ID | Tensión | Temperatura | Status |
-    rtn = "<";
-    #ifdef DEVICE_ID
-        rtn += ((int)DEVICE_ID);
-    #else
-        rtn += "***";
-    #endif
-    rtn += ">";
-
-    rtn += "voltage";
-    rtn += "=";
-    rtn += compressArray(volts, ARRAY_SIZE);
-
-    rtn += "&";
-    rtn += "temperature";
-    rtn += "=";
-    rtn += compressArray(temps, ARRAY_SIZE);
-
-    rtn += "&";
-    rtn += "status";
-    rtn += "=";
-    if (emergency) {
-        rtn += "F";
-    } else {
-        rtn += status;
-    }
-}
-
-void composeUSBPayload(float volts[], float temps[], bool emergency, float current, float gas, String& rtn) {
+void composeUSBPayload(bool emergency, bool door, float current, float gas, String& rtn) {
     // Payload USB = vector de bytes transmitidos en forma FIFO.
-    // | Tensión | Temperatura | Emergencia | Corriente | Combustible |
+    // | Sensores | Salud | Ciclo de trabajo | Emergencia | Puerta | Corriente | Combustible |
     rtn = "USB: ";
 
-    rtn += "voltage=";
-    rtn += compressArray(volts, ARRAY_SIZE);
+    Sensors::compose(rtn, ", ");
+
+    rtn += "health=";
+    rtn += (sensorHealth | Sensors::emptyMask());
     rtn += ", ";
 
-    rtn += "temperature=";
-    rtn += compressArray(temps, ARRAY_SIZE);
+    rtn += "dutycycle=";
+    rtn += dutyCycleUtilisation();
     rtn += ", ";
 
     rtn += "emergency=";
     rtn += emergency ? "1" : "0";
     rtn += ", ";
 
+    rtn += "door=";
+    rtn += door ? "1" : "0";
+    rtn += ", ";
+
     rtn += "current=";
     rtn += current;
     rtn += ", ";
@@ -48,6 +48,8 @@ void LoRaCmdObserver() {
             dayTime = true;
         } else if (incomingPayload == knownCommands[2]) {   // knownCommands[2]: nighttime
             dayTime = false;
+        } else if (incomingPayload.startsWith(knownCommands[3])) {  // knownCommands[3]: adr=<DR>,<dBm> | adr=auto
+            adrCommand(incomingPayload.substring(knownCommands[3].length()));
         } else {
             #if DEBUG_LEVEL >= 1
                 Serial.println("Descartado por payload incorrecto!");
@@ -80,6 +82,8 @@ void lightsObserver() {
         - si es un reporte de sensores, actualiza la variable statusOutcoming a 'S', 'L' o 'F'
         - si es un mensaje militar, levanta un flag que indica que la siguiente transmisión que se
         haga por LoRa sea de tipo mensaje militar, y prepara la string para que se envíe por LoRa.
+        Mientras haya un envío LoRa en curso (que lee outcomingFull recién al terminar la escucha
+        del canal), el mensaje militar espera en incomingUSB.
 */
 void usbObserver() {
     if (incomingUSBComplete) {
@@ -90,6 +94,8 @@ void usbObserver() {
             // 'USB: status=S\n'
             // en este caso, equalsPosition sería 11
             statusOutcoming = incomingUSB.substring(equalsPosition + 1, equalsPosition + 2);
+        } else if (loraTxState != LORA_TX_IDLE) {
+            return;
         } else {
             // incomingUSB típico:
             // 'USB: nro=13&o=2&d=3&cl=1&p=1&ci=0&e=1&m=xxx'
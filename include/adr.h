@@ -0,0 +1,175 @@
+/**
+    Header que contiene la adaptación de la velocidad de datos (ADR) del enlace LoRa.
+    @file adr.h
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+/*
+    Cada data rate (DR) es una combinación de spreading factor y ancho de banda, de la más robusta
+    (DR0: SF12, 125 kHz) a la más rápida (DR6: SF7, 250 kHz); cada paso reduce el tiempo en el aire
+    a aproximadamente la mitad a costa de unos 2,5 dB de margen.
+    El margen del enlace se estima con los downlinks del concentrador (los dirigidos a este nodo o
+    en broadcast): el menor entre el SNR por encima del mínimo demodulable y el RSSI por encima de
+    la sensibilidad del DR actual. Se supone un enlace recíproco y un concentrador que transmite a
+    LORA_TX_POWER_MAX, por lo que a la potencia propia se le descuenta lo que se haya reducido.
+    Cada LORA_ADR_HISTORY downlinks, con el mejor margen observado y descontando LORA_ADR_MARGIN,
+    se avanza un paso (un DR, o 3 dB de potencia) por cada 3 dB de margen sobrante, o se retrocede
+    por cada 3 dB faltantes. Si pasan LORA_ADR_BACKOFF reportes sin ningún downlink del
+    concentrador, se sube la potencia y, al llegar al máximo, se baja un DR.
+    IMPORTANTE: sólo tiene sentido con un concentrador que reciba todos los SF y responda en el DR
+    de cada nodo. Un concentrador de un solo canal y SF (por ejemplo, otro SX1278) deja de escuchar
+    al nodo apenas éste cambia de SF, por lo que LORA_ADR viene deshabilitado.
+    El comando de downlink "adr=<DR>,<dBm>" fija un DR y una potencia (y suspende la adaptación);
+    "adr=auto" la reanuda.
+*/
+
+/**
+    LoRaDataRate describe un data rate: spreading factor, ancho de banda (en Hz), SNR mínimo
+    demodulable (en dB) y sensibilidad del SX1278 (en dBm).
+*/
+struct LoRaDataRate {
+    uint8_t sf;
+    long bandwidth;
+    int8_t snrRequired;
+    int16_t sensitivity;
+};
+
+/**
+    loraDataRates contiene los data rates posibles, del más robusto al más rápido.
+*/
+const LoRaDataRate loraDataRates[] = {
+    {12, 125000, -20, -137},
+    {11, 125000, -17, -134},
+    {10, 125000, -15, -132},
+    { 9, 125000, -12, -129},
+    { 8, 125000, -10, -126},
+    { 7, 125000,  -7, -123},
+    { 7, 250000,  -7, -120}
+};
+
+#define LORA_DATA_RATES (sizeof(loraDataRates) / sizeof(loraDataRates[0])) // Cantidad de data rates.
+
+/**
+    adrApply() configura en el módulo el data rate y la potencia actuales, si cambiaron.
+    Sólo debe llamarse sin una transmisión en curso; el módulo vuelve a modo recepción.
+*/
+void adrApply() {
+    if (!adrChanged) {
+        return;
+    }
+    LoRa.idle();
+    LoRa.setSpreadingFactor(loraDataRates[loraDataRate].sf);
+    LoRa.setSignalBandwidth(loraDataRates[loraDataRate].bandwidth);
+    LoRa.setTxPower(loraTxPower);
+    LoRa.receive();
+    adrChanged = false;
+    #if DEBUG_LEVEL >= 1
+        Serial.print("ADR: DR");
+        Serial.print(loraDataRate);
+        Serial.print(" (SF");
+        Serial.print(loraDataRates[loraDataRate].sf);
+        Serial.print(", ");
+        Serial.print(loraDataRates[loraDataRate].bandwidth);
+        Serial.print(" Hz), ");
+        Serial.print(loraTxPower);
+        Serial.println(" dBm");
+    #endif
+}
+
+/**
+    adrStep() mueve el data rate y la potencia según el margen sobrante (o faltante).
+    @param steps Pasos de 3 dB: positivos para acelerar / bajar potencia, negativos para lo contrario.
+*/
+void adrStep(int steps) {
+    while (steps > 0 && loraDataRate < LORA_DATA_RATES - 1) {
+        loraDataRate++;
+        steps--;
+        adrChanged = true;
+    }
+    while (steps > 0 && loraTxPower > LORA_TX_POWER_MIN) {
+        loraTxPower = max(loraTxPower - 3, LORA_TX_POWER_MIN);
+        steps--;
+        adrChanged = true;
+    }
+    while (steps < 0 && loraTxPower < LORA_TX_POWER_MAX) {
+        loraTxPower = min(loraTxPower + 3, LORA_TX_POWER_MAX);
+        steps++;
+        adrChanged = true;
+    }
+    while (steps < 0 && loraDataRate > 0) {
+        loraDataRate--;
+        steps++;
+        adrChanged = true;
+    }
+}
+
+/**
+    adrObserve() registra la calidad de un downlink del concentrador y, cada LORA_ADR_HISTORY
+    downlinks, adapta el data rate y la potencia.
+    @param snr SNR del paquete (en dB).
+    @param rssi RSSI del paquete (en dBm).
+*/
+void adrObserve(float snr, int rssi) {
+    adrSilentReports = 0;
+    #if LORA_ADR == TRUE
+        if (adrPinned) {
+            return;
+        }
+        const LoRaDataRate& rate = loraDataRates[loraDataRate];
+        int margin = min((int)(snr - rate.snrRequired), rssi - rate.sensitivity);
+        margin -= LORA_TX_POWER_MAX - loraTxPower;
+        if (adrSamples == 0 || margin > adrBestMargin) {
+            adrBestMargin = margin;
+        }
+        if (++adrSamples >= LORA_ADR_HISTORY) {
+            // Redondea hacia abajo: un margen faltante, aunque sea menor a 3 dB, retrocede un paso.
+            int excess = adrBestMargin - LORA_ADR_MARGIN;
+            adrStep(excess >= 0 ? excess / 3 : (excess - 2) / 3);
+            adrSamples = 0;
+        }
+    #endif
+}
+
+/**
+    adrUplinkSent() se llama con cada reporte transmitido. Si pasaron LORA_ADR_BACKOFF reportes
+    sin downlinks del concentrador, retrocede un paso hacia un enlace más robusto.
+*/
+void adrUplinkSent() {
+    #if LORA_ADR == TRUE
+        if (adrPinned) {
+            return;
+        }
+        if (++adrSilentReports >= LORA_ADR_BACKOFF) {
+            adrStep(-1);
+            adrSilentReports = 0;
+            adrSamples = 0;
+        }
+    #endif
+}
+
+/**
+    adrCommand() atiende el comando de downlink "adr=<DR>,<dBm>" (fija data rate y potencia)
+    o "adr=auto" (reanuda la adaptación).
+    @param arguments Texto posterior a "adr=".
+*/
+void adrCommand(String arguments) {
+    if (arguments == "auto") {
+        adrPinned = false;
+        adrSamples = 0;
+        adrSilentReports = 0;
+        return;
+    }
+    int comma = arguments.indexOf(',');
+    if (comma == -1) {
+        #if DEBUG_LEVEL >= 1
+            Serial.println("Comando ADR incorrecto!");
+        #endif
+        return;
+    }
+    loraDataRate = constrain(arguments.substring(0, comma).toInt(), 0, (int)LORA_DATA_RATES - 1);
+    loraTxPower = constrain(arguments.substring(comma + 1).toInt(), LORA_TX_POWER_MIN, LORA_TX_POWER_MAX);
+    adrPinned = true;
+    adrChanged = true;
+}
@@ -7,31 +7,29 @@
 */
 
 /**
-    compressArray() obtiene el promedio de los valores no nulos de un array de floats.
+    averageArray() obtiene el promedio de los primeros count valores de un array de floats.
     Por ejemplo:
-        int size = 2;
-        float array[size] = {10.00, 11.00};
-        getAverage(array, size);
+        float array[3] = {10.00, 11.00, 0.00};
+        averageArray(array, 2);
     Devuelve: 10.50.
+    Si el array no tiene valores (count = 0), devuelve NAN.
     @param array Arreglo de números que se quiere promediar.
-    @param size Cantidad de elementos del array.
-    @return Promedio de los valores no nulos del array.
+    @param count Cantidad de valores cargados en el array.
+    @return Promedio de los valores cargados, redondeado a 2 decimales.
 */
-float compressArray(float array[], int size) {
+float averageArray(const float array[], uint8_t count) {
+    if (count == 0) {
+        return NAN;
+    }
     float average = 0;
-    int zerosFound = 0;
-    for (int i = 0; i < size; i++) {
+    for (uint8_t i = 0; i < count; i++) {
         average += array[i];
-        if (array[i] == 0.0) {
-            zerosFound++;
-        }
         #if DEBUG_LEVEL >= 5
             Serial.print(array[i]);
             Serial.print(" ");
         #endif
     }
-    int nonZeroValues = size - zerosFound;
-    average /= nonZeroValues;
+    average /= count;
     average = round2decimals(average);
     #if DEBUG_LEVEL >= 5
         Serial.print("Average of array: ");
@@ -42,12 +40,59 @@ float compressArray(float array[], int size) {
 }
 
 /**
-    cleanupArray() resetea todos los elementos de un array.
-    @param array Arreglo de números que se quiere limpiar.
-    @param size Cantidad de elementos del array.
+    averageSum() obtiene el promedio de count muestras de punto flotante a partir de su suma.
+    Por ejemplo:
+        averageSum(21.00, 2);
+    Devuelve: 10.50.
+    Si no hay muestras (count = 0), devuelve NAN.
+    @param sum Suma de las muestras.
+    @param count Cantidad de muestras sumadas.
+    @return Promedio de las muestras, redondeado a 2 decimales.
+*/
+float averageSum(float sum, uint16_t count) {
+    if (count == 0) {
+        return NAN;
+    }
+    return round2decimals(sum / count);
+}
+
+/**
+    averageSum() obtiene el promedio de count muestras enteras a partir de su suma en 32 bits,
+    redondeando al entero más cercano (sin aritmética de punto flotante).
+    Por ejemplo:
+        averageSum(6145, 2);
+    Devuelve: 3073.
+    Si no hay muestras (count = 0), devuelve 0.
+    @param sum Suma de las muestras.
+    @param count Cantidad de muestras sumadas.
+    @return Promedio de las muestras.
+*/
+int16_t averageSum(int32_t sum, uint16_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    sum += sum >= 0 ? count / 2 : -(count / 2);
+    return sum / count;
+}
+
+/**
+    median3() obtiene la mediana de tres valores con una red de ordenamiento de tres
+    comparaciones (sin arrays ni memoria extra). Sirve para cualquier tipo comparable.
+    Por ejemplo:
+        median3(2230, -16256, 2231);
+    Devuelve: 2230.
+    @param a, b, c Valores de los que se quiere la mediana.
+    @return Mediana de los tres valores.
 */
-void cleanupArray(float array[], int size) {
-    for (int i = 0; i < size; i++) {
-        array[i] = 0.0;
+template <typename T>
+T median3(T a, T b, T c) {
+    if (a > b) {
+        T swap = a;
+        a = b;
+        b = swap;
+    }
+    if (b > c) {
+        b = c;
     }
+    return a > b ? a : b;
 }
@@ -20,25 +20,90 @@
 #define INCOMING_PAYLOAD_MAX_SIZE 100                                               // Tamaño máximo esperado del payload LoRa entrante.
 #define INCOMING_FULL_MAX_SIZE (INCOMING_PAYLOAD_MAX_SIZE + DEVICE_ID_MAX_SIZE + 2) // Tamaño máximo esperado del mensaje entrante.
 #define MAX_SIZE_OUTCOMING_LORA_REPORT 200                                          // Tamaño máximo esperado del payload LoRa saliente.
-#define KNOWN_COMMANDS_SIZE 3                                                       // Cantidad de comandos LoRa conocidos.
+#define KNOWN_COMMANDS_SIZE 5                                                       // Cantidad de comandos LoRa conocidos.
 #define LORA_TIMEOUT 20                                                             // Tiempo entre cada mensaje LoRa.
 #define LORA_SYNC_WORD 0x34                                                         // Palabra de sincronización LoRa.
+#define LORA_DUTY_CYCLE 10                                                          // Ciclo de trabajo máximo de las transmisiones (en milésimas).
+#define LORA_DUTY_WINDOW 3600                                                       // Ventana móvil sobre la que se mide el ciclo de trabajo (en s).
+#define LORA_DUTY_BUCKETS 12                                                        // Intervalos en que se divide la ventana móvil (ver duty_cycle.h).
+#define LORA_DUTY_BUDGET ((unsigned long)LORA_DUTY_WINDOW * LORA_DUTY_CYCLE)        // Tiempo en el aire permitido por ventana (en ms).
+#define LORA_ADR FALSE                                                              // Adaptar data rate y potencia (requiere un concentrador multi-SF, ver adr.h).
+#define LORA_ADR_DR 5                                                               // Data rate inicial (o fijo, sin ADR): DR5 = SF7, 125 kHz.
+#define LORA_ADR_MARGIN 10                                                          // Margen de enlace que se reserva antes de acelerar (en dB).
+#define LORA_ADR_HISTORY 4                                                          // Downlinks del concentrador por cada adaptación.
+#define LORA_ADR_BACKOFF 6                                                          // Reportes sin downlinks antes de volver a un enlace más robusto.
+#define LORA_TX_POWER_MAX 17                                                        // Potencia de transmisión máxima (e inicial) (en dBm).
+#define LORA_TX_POWER_MIN 2                                                         // Potencia de transmisión mínima (en dBm).
+#define LORA_RX_QUEUE_SLOTS 3                                                       // Paquetes recibidos que pueden esperar a downlinkObserver().
+#define LORA_TDMA TRUE                                                              // Reportar en un slot fijo de cada trama, alineado con el beacon del concentrador (ver tdma.h).
+#define LORA_TDMA_SLOTS 20                                                          // Slots por trama de LORA_TIMEOUT s (el slot 0 es del beacon).
+#define LORA_TDMA_GUARD 50                                                          // Guarda al comienzo de cada slot (en ms).
+#define LORA_TDMA_WINDOW 250                                                        // Demora máxima para empezar a transmitir en el slot (en ms).
+#define LORA_TDMA_HOLDOVER 30                                                       // Tramas sin beacon antes de perder la sincronización.
+#define LORA_TDMA_MAX_DRIFT 200000L                                                 // Corrección de deriva máxima (en us por trama).
+#define LORA_LBT TRUE                                                               // Escuchar el canal (CAD) antes de transmitir (listen-before-talk), salvo en el slot TDMA.
+#define LORA_LBT_ATTEMPTS 4                                                         // Canal ocupado tantas veces seguidas: se transmite de todos modos.
+#define LORA_LBT_SLOT 100                                                           // Unidad de la espera aleatoria tras detectar actividad (en ms).
+#define LORA_CAD_TIMEOUT 100                                                        // Tiempo máximo de espera de CAD_DONE (en ms).
+#define LORA_TX_TIMEOUT 5                                                           // Tiempo máximo de espera de TX_DONE antes de forzar el modo recepción (en s).
+#define LORA_BINARY_FRAME FALSE                                                     // Reportar con la trama binaria en lugar del payload de texto (ver docs/Trama binaria LoRa.md).
+#define LORA_FRAME_VERSION 1                                                        // Versión de la trama binaria.
+#define LORA_FRAME_MAX_SIZE (7 + 2 * 16)                                            // Tamaño máximo de la trama binaria (cabecera + 16 canales).
 
 /// Watchdog.
 #define USE_WATCHDOG_TMR TRUE
 #define WATCHDOG_TMR 8
 
+/// Salud de los sensores (bits del campo "health" de cada reporte).
+#define HEALTH_TENSION_TIMEOUT 0       // Alguna ventana de tensión terminó por timeout (se descarta).
+#define HEALTH_TENSION_SIN_DATOS 1     // No hubo mediciones de tensión válidas en el intervalo.
+#define HEALTH_TEMPERATURA_FALLA 2     // Alguna sonda no respondió (desconexión, CRC o bus sin sondas).
+#define HEALTH_TEMPERATURA_SIN_DATOS 3 // No hubo mediciones de temperatura válidas en el intervalo.
+#define HEALTH_EXPANSION_SIN_DATOS 4   // El barrido del puerto de expansión no entregó muestras en el intervalo.
+
 /// Arrays.
-#define SENSORS_QTY 2          // Cantidad de sensores conectados.
-#define TIMEOUT_READ_SENSORS 2 // Tiempo entre mediciones.
-#define ARRAY_SIZE (LORA_TIMEOUT / TIMEOUT_READ_SENSORS + 3)
+#define TIMEOUT_READ_SENSORS 2 // Tiempo entre actualizaciones de las luces.
 #define TIMING_SLOTS 4 // Cantidad de slots necesarios de timing (ver timing_helpers.h)
 
 // Sensor de tensión.
 #define EMON_VOLTAGE_CAL 226.0
 #define EMON_PHASE_CAL 1.7
+#define TENSION_PERIODO 2 // Tiempo entre mediciones de tensión (en s).
+#define TENSION_FASE 0    // Desfasaje de las mediciones de tensión (en s).
 #define EMON_CROSSINGS 20 // Cantidad de semi-ondas muestreadas para medir tensión y/o corriente.
 #define EMON_TIMEOUT 1000 // Timeout de la rutina calcVI (en ms).
+#define EMON_SAMPLE_RATE 2000 // Muestreo por Timer1 (en Hz, múltiplo de EMON_MAINS_FREQ); 0 para muestrear por software (sin frecuencia de línea si la ventana excede EMON_STEP_BUDGET).
+#define EMON_MAINS_FREQ 50    // Frecuencia nominal de línea (en Hz).
+#define EMON_STEP_BUDGET 1000 // Tiempo máximo de muestreo de tensión por cada pasada de loop() (en us, sólo por software).
+#define EMON_OVERSAMPLING_BITS 0  // Bits extra por sobremuestreo: cada muestra promedia 4^n conversiones (0 a 3, sólo por software; con 2 o más cada muestra abarca un tramo de la onda y la tensión medida cae, ver test_emon_oversampling).
+#define EMON_ADC_NOISE_SLEEP FALSE // Dormir en modo ADC noise reduction durante cada conversión (atrasa millis() y, con clkIO detenido, la UART pierde lo que llega por USB mientras duerme; sólo por software).
+
+// Sensor de temperatura.
+#define TEMPERATURA_PERIODO 10         // Tiempo entre mediciones de temperatura (en s).
+#define TEMPERATURA_FASE 1             // Desfasaje respecto de la tensión, para que las mediciones no coincidan (en s).
+#define TEMPERATURA_PROBES 3           // Cantidad máxima de sondas DS18B20 en el bus (ambiente, batería, rack).
+#define TEMPERATURA_ROM_EEPROM TRUE    // Persistir las direcciones ROM de los DS18B20 en EEPROM para un arranque rápido.
+#define TEMPERATURA_ROM_EEPROM_ADDR 0  // Posición de la EEPROM donde se guardan las direcciones ROM (1 + 8 bytes por sonda).
+#define TEMPERATURA_RES_MIN 9          // Resolución con temperatura estable (94 ms de conversión).
+#define TEMPERATURA_RES_MAX 12         // Resolución cerca de un umbral de alerta (750 ms de conversión).
+#define TEMPERATURA_DELTA_LENTO 0.25   // Variación entre mediciones a partir de la cual se pasa a 10 bits (en °C).
+#define TEMPERATURA_DELTA_RAPIDO 1.0   // Variación entre mediciones a partir de la cual se pasa a 11 bits (en °C).
+#define TEMPERATURA_UMBRAL_ALTO 50.0   // Umbral de alerta por sobretemperatura (en °C).
+#define TEMPERATURA_UMBRAL_BAJO 0.0    // Umbral de alerta por baja temperatura (en °C).
+#define TEMPERATURA_MARGEN 2.0         // Distancia a un umbral de alerta que fuerza TEMPERATURA_RES_MAX (en °C).
+#define TEMPERATURA_RAW(c) ((int16_t)((c) * 128)) // Conversión de °C a cuentas crudas del DS18B20 (1/128 °C).
+
+// Puerto de expansión (entradas analógicas A3 a A7 del conector DB9 (2)).
+#define EXPANSION_CHANNELS 5       // Canales del puerto de expansión (A3 a A7).
+#define EXPANSION_MASK 0b00000     // Canales habilitados: bit 0 = A3, ..., bit 4 = A7 (0 deshabilita el barrido).
+#define EXPANSION_NOMBRES { "analog3", "analog4", "analog5", "analog6", "analog7" } // Nombre de cada canal en el payload.
+#define EXPANSION_SCAN_RATE 500    // Conversiones por segundo del barrido, repartidas entre los canales (en Hz).
+#define EXPANSION_VREF_MV 5000     // Tensión de referencia (AVcc) para convertir cuentas a volts (en mV).
+#define EXPANSION_PERIODO 10       // Tiempo entre promedios del puerto de expansión (en s).
+#define EXPANSION_FASE 3           // Desfasaje de los promedios del puerto de expansión (en s).
+
+// Entradas por interrupción (puerta y botón antipánico).
+#define INPUTS_DEBOUNCE_MS 30 // Tiempo sin flancos para dar por estable el nivel de una entrada (en ms).
 
 // Sensor de puerta abierta.
 #define PUERTA_ABIERTA HIGH // Señal entrante cuando la puerta está abierta.
@@ -19,3 +19,27 @@ float round2decimals(float var) {
     float value = (int)(var * 100 + 0.5);
     return (float)(value / 100);
 }
+
+/**
+    appendFixedPoint() agrega a una String un número en punto fijo con 2 decimales,
+    sin pasar por float (ni por el formateador de floats de Arduino).
+    Por ejemplo:
+        String rtn = "";
+        appendFixedPoint(rtn, -305);
+    rtn pasa a ser "-3.05".
+    @param &rtn Dirección de memoria de la String a completar.
+    @param hundredths Número expresado en centésimas.
+*/
+void appendFixedPoint(String& rtn, int32_t hundredths) {
+    if (hundredths < 0) {
+        rtn += '-';
+        hundredths = -hundredths;
+    }
+    rtn += (unsigned long)(hundredths / 100);
+    rtn += '.';
+    unsigned int decimals = hundredths % 100;
+    if (decimals < 10) {
+        rtn += '0';
+    }
+    rtn += decimals;
+}
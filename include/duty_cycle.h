@@ -0,0 +1,78 @@
+/**
+    Header que contiene la contabilidad del ciclo de trabajo (duty cycle) de las transmisiones LoRa.
+    @file duty_cycle.h
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+/*
+    El tiempo en el aire de cada transmisión (ver LoRa.timeOnAir()) se acumula en
+    LORA_DUTY_BUCKETS intervalos que, en conjunto, cubren los últimos LORA_DUTY_WINDOW segundos.
+    Al vencer un intervalo se descarta el más antiguo, por lo que la suma de todos es el tiempo
+    en el aire de la ventana móvil, que no debe superar LORA_DUTY_BUDGET.
+    Un reporte que excedería el presupuesto se difiere: las mediciones siguen acumulándose y se
+    reportan, promediadas, en la próxima transmisión permitida.
+*/
+
+#define LORA_DUTY_BUCKET_MS (sec2ms(LORA_DUTY_WINDOW) / LORA_DUTY_BUCKETS) // Duración de cada intervalo (en ms).
+
+/**
+    dutyCycleRotate() descarta los intervalos vencidos desde el último llamado.
+    Si pasó más de una ventana entera, vacía la contabilidad y la resincroniza.
+*/
+void dutyCycleRotate() {
+    unsigned long now = millis();
+    if (now - dutyCycleBucketStart >= sec2ms(LORA_DUTY_WINDOW)) {
+        for (uint8_t i = 0; i < LORA_DUTY_BUCKETS; i++) {
+            dutyCycleAirtime[i] = 0;
+        }
+        dutyCycleBucketStart = now;
+        return;
+    }
+    while (now - dutyCycleBucketStart >= LORA_DUTY_BUCKET_MS) {
+        dutyCycleBucket = (dutyCycleBucket + 1) % LORA_DUTY_BUCKETS;
+        dutyCycleAirtime[dutyCycleBucket] = 0;
+        dutyCycleBucketStart += LORA_DUTY_BUCKET_MS;
+    }
+}
+
+/**
+    dutyCycleUsed() devuelve el tiempo en el aire acumulado en la ventana móvil.
+    @return Tiempo en el aire (en ms).
+*/
+unsigned long dutyCycleUsed() {
+    dutyCycleRotate();
+    unsigned long used = 0;
+    for (uint8_t i = 0; i < LORA_DUTY_BUCKETS; i++) {
+        used += dutyCycleAirtime[i];
+    }
+    return used;
+}
+
+/**
+    dutyCycleAllows() indica si una transmisión entra en el presupuesto de la ventana móvil.
+    @param airtime Tiempo en el aire de la transmisión (en ms).
+    @return true si puede transmitirse sin exceder LORA_DUTY_BUDGET.
+*/
+bool dutyCycleAllows(unsigned long airtime) {
+    return dutyCycleUsed() + airtime <= LORA_DUTY_BUDGET;
+}
+
+/**
+    dutyCycleCharge() descuenta una transmisión del presupuesto.
+    @param airtime Tiempo en el aire de la transmisión (en ms).
+*/
+void dutyCycleCharge(unsigned long airtime) {
+    dutyCycleRotate();
+    dutyCycleAirtime[dutyCycleBucket] += airtime;
+}
+
+/**
+    dutyCycleUtilisation() devuelve la fracción del presupuesto utilizada en la ventana móvil.
+    Puede superar 100 si se transmitieron emergencias con el presupuesto agotado.
+    @return Porcentaje de LORA_DUTY_BUDGET utilizado.
+*/
+uint16_t dutyCycleUtilisation() {
+    return (dutyCycleUsed() * 100) / LORA_DUTY_BUDGET;
+}
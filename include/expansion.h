@@ -0,0 +1,93 @@
+/**
+    Header que contiene el barrido en segundo plano del puerto de expansión (A3 a A7).
+    @file expansion.h
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+/*
+    Mientras el canal de tensión no está midiendo, Timer1 dispara una conversión cada
+    1 / EXPANSION_SCAN_RATE segundos y la interrupción del ADC (ver EmonLib::attachIdleADC())
+    acumula la muestra en el canal actual y pasa al siguiente canal habilitado en EXPANSION_MASK.
+    loop() sólo lee los promedios acumulados (ver ExpansionSensor en sensors.h), por lo que sumar
+    entradas analógicas no consume tiempo de primer plano.
+    Durante una ventana de tensión el barrido se pausa, ya que comparte el ADC y Timer1.
+*/
+
+#define EXPANSION_FIRST_MUX 3 // Canal del multiplexor del ADC correspondiente a A3.
+
+/**
+    expansionSample() es llamada desde la interrupción del ADC con cada conversión que no
+    pertenece a una ventana de tensión. Acumula la muestra y selecciona el próximo canal.
+    @param value Resultado de la conversión (0 a 1023).
+*/
+void expansionSample(int value) {
+    if (!expansionScanning) {
+        return;
+    }
+    // La primera conversión luego de reanudar puede arrastrar la referencia de readVcc().
+    if (expansionDiscard) {
+        expansionDiscard = false;
+    } else if (expansionCounts[expansionChannel] < 0xFFFF) {
+        expansionSums[expansionChannel] += value;
+        expansionCounts[expansionChannel]++;
+    }
+    do {
+        expansionChannel = (expansionChannel + 1) % EXPANSION_CHANNELS;
+    } while (!bitRead(EXPANSION_MASK, expansionChannel));
+    // Toma efecto en la próxima conversión, que dispara Timer1.
+    ADMUX = _BV(REFS0) | (EXPANSION_FIRST_MUX + expansionChannel);
+}
+
+/**
+    expansionResume() (re)inicia el barrido: configura Timer1 en modo CTC a EXPANSION_SCAN_RATE
+    como disparo automático del ADC.
+*/
+void expansionResume() {
+    #if EXPANSION_MASK
+        expansionChannel = 0;
+        while (!bitRead(EXPANSION_MASK, expansionChannel)) {
+            expansionChannel++;
+        }
+        ADMUX = _BV(REFS0) | (EXPANSION_FIRST_MUX + expansionChannel);
+
+        TCCR1B = 0;
+        TCCR1A = 0;
+        TCNT1 = 0;
+        OCR1A = (F_CPU / 8) / EXPANSION_SCAN_RATE - 1;
+        OCR1B = OCR1A;
+        TIFR1 = _BV(OCF1B);
+
+        expansionDiscard = true;
+        expansionScanning = true;
+        ADCSRB = (ADCSRB & ~(_BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0))) | _BV(ADTS2) | _BV(ADTS0);
+        ADCSRA |= _BV(ADIF) | _BV(ADATE) | _BV(ADIE);
+        TCCR1B = _BV(WGM12) | _BV(CS11);
+    #endif
+}
+
+/**
+    expansionPause() detiene el barrido y espera a que termine la conversión en curso, dejando
+    el ADC y Timer1 libres para una ventana de tensión.
+*/
+void expansionPause() {
+    #if EXPANSION_MASK
+        expansionScanning = false;
+        TCCR1B = 0;
+        ADCSRA &= ~(_BV(ADATE) | _BV(ADIE));
+        while (bit_is_set(ADCSRA, ADSC));
+    #endif
+}
+
+/**
+    setupExpansionPort() deshabilita el buffer digital de los canales habilitados (sólo existe
+    para A3 a A5), registra a expansionSample() en EmonLib e inicia el barrido.
+*/
+void setupExpansionPort() {
+    #if EXPANSION_MASK
+        DIDR0 |= (EXPANSION_MASK & 0x07) << EXPANSION_FIRST_MUX;
+        EnergyMonitor::attachIdleADC(expansionSample);
+        expansionResume();
+    #endif
+}
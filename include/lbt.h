@@ -0,0 +1,33 @@
+/**
+    Header que contiene la política de escucha antes de transmitir (listen-before-talk) de LoRa.
+    @file lbt.h
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+/*
+    Antes de cada reporte sin coordinación (ALOHA) el nodo escucha el canal con una detección de
+    actividad (CAD). Si el canal está ocupado, espera un tiempo aleatorio en modo recepción y vuelve
+    a escuchar; la espera crece exponencialmente con cada intento para no volver a coincidir con los
+    demás nodos que esperaban el mismo canal. Luego de LORA_LBT_ATTEMPTS intentos, transmite igual.
+*/
+
+/**
+    lbtRetry() decide qué hacer al terminar una detección de actividad.
+    @param detected true si el CAD detectó actividad en el canal.
+    @param attempts Esperas ya hechas para este paquete.
+    @return true para esperar lbtBackoff() y volver a escuchar, false para transmitir.
+*/
+bool lbtRetry(bool detected, uint8_t attempts) {
+    return detected && attempts < LORA_LBT_ATTEMPTS;
+}
+
+/**
+    lbtBackoff() sortea la espera antes de volver a escuchar el canal.
+    @param attempt Número de intento (de 1 a LORA_LBT_ATTEMPTS).
+    @return Espera entre LORA_LBT_SLOT y LORA_LBT_SLOT * 2^attempt ms.
+*/
+unsigned long lbtBackoff(uint8_t attempt) {
+    return random(LORA_LBT_SLOT, (long)LORA_LBT_SLOT << attempt);
+}
@@ -0,0 +1,102 @@
+/**
+    Header que contiene la composición de los reportes LoRa: el payload de texto y su equivalente
+    binario (ver docs/Trama binaria LoRa.md).
+    @file lora_payload.h
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+/**
+    composeLoRaPayload() se encarga de crear la string de carga útil de LoRa,
+    a partir de los estados actuales de los sensores.
+    Los campos de medición se generan desde el registro de sensores (ver Sensors en sensors.h):
+    uno por canal, con el promedio de las muestras tomadas desde la última transmisión.
+    Por ejemplo, si:
+        DEVICE_ID = 10009
+        tensiones medidas = {220.00, 230.00}
+        temperaturas medidas = {{24.00, 25.00}, {30.00, 31.00}}
+        status = "S"
+    Entonces, esta función sobreescribe la String a retornar con:
+        "<10009>voltage=225.00&frequency=50.01&crest=1.41&distortion=0.03&temperature=24.50&temperature2=30.50&health=0&door=0&status=S"
+    health es la máscara de bits HEALTH_* (ver constants.h) de las fallas del intervalo, de modo
+    que el concentrador pueda distinguir un dato inválido de uno real.
+    @param emergency Estado del botón antipánico.
+    @param door true si la puerta está abierta o se abrió desde el último reporte.
+    @param status Estado de la cabina.
+    @param &rtn Dirección de memoria de la String a componer.
+*/
+void composeLoRaPayload(bool emergency, bool door, String status, String& rtn) {
+    // Payload LoRA = vector de bytes transmitidos en forma FIFO.
+    // | Dev ID | Sensores | Salud | Puerta | Status |
+    rtn = "<";
+    #ifdef DEVICE_ID
+        rtn += ((int)DEVICE_ID);
+    #else
+        rtn += "***";
+    #endif
+    rtn += ">";
+
+    Sensors::compose(rtn, "&");
+
+    rtn += "health";
+    rtn += "=";
+    rtn += (sensorHealth | Sensors::emptyMask());
+    rtn += "&";
+
+    rtn += "door";
+    rtn += "=";
+    rtn += door ? "1" : "0";
+    rtn += "&";
+
+    rtn += "status";
+    rtn += "=";
+    if (emergency) {
+        rtn += "F";
+    } else {
+        rtn += status;
+    }
+}
+
+/**
+    composeLoRaFrame() se encarga de crear la trama binaria de LoRa, equivalente al payload de
+    composeLoRaPayload() pero de una fracción de su tamaño (y de su tiempo en el aire).
+    Formato (versión LORA_FRAME_VERSION, enteros little-endian):
+        | Versión (1) | Dev ID (2) | Flags (1) | Salud (1) | Canales presentes (2) | Canal (2) x N |
+    Flags: bits 0-1 = status (0 = 'S', 1 = 'L', 2 = 'F'), bit 2 = emergencia, bit 3 = puerta.
+    Cada canal presente es un int16 en centésimas de su unidad, en el orden del registro de sensores.
+    El decodificador para el concentrador está en tools/lora_frame.py (ver docs/Trama binaria
+    LoRa.md).
+    @param emergency Estado del botón antipánico.
+    @param door true si la puerta está abierta o se abrió desde el último reporte.
+    @param status Estado de la cabina.
+    @param frame Buffer de al menos LORA_FRAME_MAX_SIZE bytes.
+    @return Cantidad de bytes escritos en frame.
+*/
+uint8_t composeLoRaFrame(bool emergency, bool door, String status, uint8_t frame[]) {
+    uint8_t* position = frame + 7;
+    uint16_t present = 0;
+    Sensors::encode(position, present, 0);
+
+    uint8_t flags = 0;
+    if (emergency || status == "F") {
+        flags = 2;
+    } else if (status == "L") {
+        flags = 1;
+    }
+    if (emergency) {
+        bitSet(flags, 2);
+    }
+    if (door) {
+        bitSet(flags, 3);
+    }
+
+    frame[0] = LORA_FRAME_VERSION;
+    frame[1] = lowByte((uint16_t)DEVICE_ID);
+    frame[2] = highByte((uint16_t)DEVICE_ID);
+    frame[3] = flags;
+    frame[4] = sensorHealth | Sensors::emptyMask();
+    frame[5] = lowByte(present);
+    frame[6] = highByte(present);
+    return position - frame;
+}
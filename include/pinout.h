@@ -48,6 +48,8 @@
             - Sensor de temperatura = A2.
             - Actuador buzzer (y LED) = A1.
             - Actuador iluminación cabina = D7.
+        - Puerto de expansión, RS232 (2):
+            - Entradas analógicas = A3 a A7 (ver EXPANSION_MASK en constants.h y expansion.h).
 */
 
 // Pinout sensores y actuadores.
@@ -57,6 +59,7 @@
 #define RELE_PIN 7
 #define PUERTA_PIN 6
 #define ANTIPANICO_PIN 5
+#define INPUTS_PCINT_vect PCINT2_vect // Vector PCINT del puerto de PUERTA_PIN y ANTIPANICO_PIN (PORTD).
 
 // Instanciamiento de objetos relacionados al pinout.
 EnergyMonitor eMon;
@@ -66,8 +69,9 @@ EnergyMonitor eMon;
 #endif
 
 /**
-    setupPinout() determina las I/Os digitales, inicializa al DS18B20
-    y calibra el módulo sensor de tensión.
+    setupPinout() determina las I/Os digitales, configura el sobremuestreo y calibra el
+    módulo sensor de tensión.
+    El DS18B20 se inicializa aparte, en setupTemperatureProbes() (ver sensors.h).
 */
 void setupPinout() {
     #ifdef BUZZER_PIN
@@ -86,8 +90,11 @@ void setupPinout() {
     digitalWrite(BUZZER_PIN, BUZZER_INACTIVO);
     digitalWrite(RELE_PIN, LUZ_ENCENDIDA);
 
-    #ifdef TEMPERATURA_PIN
-        sensorDS18B20.begin();
+    #if EMON_SAMPLE_RATE == 0
+        // Por Timer1 cada conversión es una muestra: el sobremuestreo sólo aplica por software.
+        eMon.voltageOversampling(EMON_OVERSAMPLING_BITS, EMON_ADC_NOISE_SLEEP == TRUE);
     #endif
     eMon.voltage(TENSION_PIN, EMON_VOLTAGE_CAL, EMON_PHASE_CAL);
+    // Ventanas de exactamente EMON_CROSSINGS / 2 ciclos, muestreadas por Timer1.
+    eMon.voltageTimerSampling(EMON_SAMPLE_RATE, EMON_MAINS_FREQ);
 }
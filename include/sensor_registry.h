@@ -0,0 +1,253 @@
+/**
+    Header que contiene el registro de sensores, resuelto en tiempo de compilación.
+    @file sensor_registry.h
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+/*
+    Cada sensor se describe con un "driver": una estructura sin estado que declara
+        - Sample: el tipo de cada muestra,
+        - CHANNELS: la cantidad de canales (series) que entrega en cada medición (hasta 8),
+        - PERIOD: el intervalo entre mediciones (en segundos),
+        - HEALTH_EMPTY: el bit de sensorHealth que indica que no hubo muestras en el intervalo
+        (las fallas puntuales las marca el propio driver en sensorHealth),
+        - PHASE: el desfasaje de sus mediciones (en segundos), para escalonar sensores con
+        mediciones costosas y que nunca coincidan,
+        - read(out, valid): avanza la medición sin bloquear; devuelve true cuando terminó,
+        dejando en out[] un valor por canal y en valid una máscara de bits con los canales válidos,
+        - hundredths(value): convierte el promedio de un canal a centésimas de su unidad, que es
+        como se reporta (en punto fijo en el payload de texto, como int16 en la trama binaria),
+        - reported(channel): indica si el canal debe reportarse,
+        - name(channel, rtn): agrega a rtn el nombre del campo del canal en el payload de texto.
+    SensorRegistry<Driver1, Driver2, ...> genera, sin despacho en tiempo de ejecución, el
+    almacenamiento de las series, el agendado de los refrescos y los campos del payload.
+    Agregar un sensor consiste en escribir su driver y sumarlo a la lista (ver sensors.h).
+    Antes de acumularse, cada muestra pasa por una mediana móvil de 3 (ver median3()), de modo que
+    un valor aislado fuera de rango (un pico de tensión, un 85 °C de reset del DS18B20, etc.) no
+    llega al promedio. El filtro sólo guarda las dos muestras anteriores de cada canal y descarta
+    las dos primeras: toda muestra acumulada es la mediana de tres reales, nunca un valor solo.
+    Un driver cuyos canales cambian de significado (p. ej., sondas redescubiertas en otro orden)
+    reinicia el filtro con SensorSeries<Driver>::restartFilter().
+    De cada canal se guarda sólo la suma y la cantidad de muestras desde la última transmisión: un
+    reporte diferido (por el ciclo de trabajo o un slot TDMA perdido) promedia todo el intervalo.
+*/
+
+/**
+    SampleSum<Sample> es el tipo del acumulador de un canal: el mismo tipo para las muestras de
+    punto flotante, y 32 bits para las enteras de 16 bits (65535 muestras no lo desbordan).
+*/
+template <typename Sample>
+struct SampleSum {
+    typedef Sample Type;
+};
+
+template <>
+struct SampleSum<int16_t> {
+    typedef int32_t Type;
+};
+
+/**
+    SensorSeries<Driver> contiene el almacenamiento de un driver: la suma y la cantidad de
+    muestras válidas de cada canal tomadas desde la última transmisión LoRa, el pedido de
+    refresco pendiente y el instante del último refresco. Además, guarda las dos últimas muestras
+    de cada canal para el filtro de mediana y cuántas lleva (hasta 2), que no se vacían entre
+    transmisiones.
+*/
+template <typename Driver>
+struct SensorSeries {
+    typedef typename SampleSum<typename Driver::Sample>::Type Sum;
+    static Sum sum[Driver::CHANNELS];
+    static uint16_t count[Driver::CHANNELS];
+    static typename Driver::Sample history[Driver::CHANNELS][2];
+    static uint8_t primed[Driver::CHANNELS];
+    static bool requested;
+    static unsigned long lastRefresh;
+
+    /**
+        restartFilter() olvida la historia del filtro de todos los canales: las dos muestras
+        siguientes de cada uno vuelven a descartarse.
+    */
+    static void restartFilter() {
+        memset(primed, 0, sizeof(primed));
+    }
+};
+
+template <typename Driver>
+typename SensorSeries<Driver>::Sum SensorSeries<Driver>::sum[Driver::CHANNELS];
+
+template <typename Driver>
+uint16_t SensorSeries<Driver>::count[Driver::CHANNELS];
+
+template <typename Driver>
+typename Driver::Sample SensorSeries<Driver>::history[Driver::CHANNELS][2];
+
+template <typename Driver>
+uint8_t SensorSeries<Driver>::primed[Driver::CHANNELS];
+
+template <typename Driver>
+bool SensorSeries<Driver>::requested = false;
+
+// lastRefresh arranca un período antes del desfasaje (el desborde del unsigned long es
+// intencional), para que el primer refresco venza a los PHASE segundos del arranque.
+template <typename Driver>
+unsigned long SensorSeries<Driver>::lastRefresh = (unsigned long)Driver::PHASE * 1000 - (unsigned long)Driver::PERIOD * 1000;
+
+template <typename... Drivers>
+struct SensorRegistry;
+
+/**
+    Caso base del registro (lista de drivers vacía).
+*/
+template <>
+struct SensorRegistry<> {
+    static void schedule(unsigned long now) {}
+    static void poll() {}
+    static void clear() {}
+    static void compose(String& rtn, const char* separator) {}
+    static void encode(uint8_t*& frame, uint16_t& present, uint8_t index) {}
+    static uint8_t emptyMask() { return 0; }
+};
+
+template <typename Head, typename... Tail>
+struct SensorRegistry<Head, Tail...> {
+    typedef SensorSeries<Head> Series;
+    typedef SensorRegistry<Tail...> Next;
+    typedef typename Head::Sample Sample;
+
+    /**
+        filter() aplica la mediana móvil de 3 a una nueva muestra de un canal. Las dos primeras
+        muestras de cada canal (desde el arranque o desde restartFilter()) sólo completan la
+        historia: un valor aislado fuera de rango al comienzo no puede salir del filtro.
+        @param ch Canal de la muestra.
+        @param &value Muestra recién medida; si devuelve true, la mediana entre ella y las dos
+        anteriores del canal.
+        @return true si value contiene una muestra filtrada para acumular.
+    */
+    static bool filter(uint8_t ch, Sample& value) {
+        Sample* history = Series::history[ch];
+        if (Series::primed[ch] < 2) {
+            history[Series::primed[ch]++] = value;
+            return false;
+        }
+        Sample median = median3(history[0], history[1], value);
+        history[0] = history[1];
+        history[1] = value;
+        value = median;
+        return true;
+    }
+
+    /**
+        schedule() pide el refresco de cada sensor cuyo PERIOD haya vencido. Los refrescos avanzan
+        de a un período exacto para conservar el desfasaje entre sensores; si loop() se atrasó más
+        de un período entero, se resincroniza con el instante actual.
+        @param now Valor actual de millis().
+    */
+    static void schedule(unsigned long now) {
+        if (now - Series::lastRefresh >= sec2ms(Head::PERIOD)) {
+            Series::lastRefresh += sec2ms(Head::PERIOD);
+            if (now - Series::lastRefresh >= sec2ms(Head::PERIOD)) {
+                Series::lastRefresh = now;
+            }
+            Series::requested = true;
+            #if DEBUG_LEVEL >= 4
+                Serial.println("Refrescando sensor!");
+            #endif
+        }
+        Next::schedule(now);
+    }
+
+    /**
+        poll() avanza la medición de cada sensor con un refresco pendiente y, cuando termina,
+        acumula las muestras válidas, ya filtradas, en sus series (una serie llena, tras 65535
+        muestras sin transmitir, deja de acumular). Un reporte no interrumpe las mediciones: la
+        que termina después de clear() se acumula para el reporte siguiente.
+    */
+    static void poll() {
+        if (Series::requested) {
+            Sample sample[Head::CHANNELS];
+            uint8_t valid = 0;
+            if (Head::read(sample, valid)) {
+                for (uint8_t ch = 0; ch < Head::CHANNELS; ch++) {
+                    if (!bitRead(valid, ch)) {
+                        continue;
+                    }
+                    if (filter(ch, sample[ch]) && Series::count[ch] < 0xFFFF) {
+                        Series::sum[ch] += sample[ch];
+                        Series::count[ch]++;
+                    }
+                }
+                Series::requested = false;
+            }
+        }
+        Next::poll();
+    }
+
+    /**
+        clear() vacía las series de todos los sensores.
+    */
+    static void clear() {
+        for (uint8_t ch = 0; ch < Head::CHANNELS; ch++) {
+            Series::sum[ch] = 0;
+            Series::count[ch] = 0;
+        }
+        Next::clear();
+    }
+
+    /**
+        compose() agrega al payload un campo "nombre=promedio" por cada canal reportable,
+        cada uno seguido del separador. Un canal sin muestras se reporta como "nan".
+        @param &rtn Dirección de memoria de la String a componer.
+        @param separator Separador entre campos ("&" en LoRa, ", " en USB).
+    */
+    static void compose(String& rtn, const char* separator) {
+        for (uint8_t ch = 0; ch < Head::CHANNELS; ch++) {
+            if (Head::reported(ch)) {
+                Head::name(ch, rtn);
+                rtn += "=";
+                if (Series::count[ch] > 0) {
+                    appendFixedPoint(rtn, Head::hundredths(averageSum(Series::sum[ch], Series::count[ch])));
+                } else {
+                    rtn += "nan";
+                }
+                rtn += separator;
+            }
+        }
+        Next::compose(rtn, separator);
+    }
+
+    /**
+        encode() agrega a la trama binaria el promedio de cada canal reportable con muestras, como
+        int16 little-endian en centésimas de su unidad (saturado a ±32767), y marca su bit en present.
+        Cada canal ocupa un bit fijo: el índice del canal dentro de todo el registro.
+        @param &frame Puntero a la próxima posición libre de la trama (avanza).
+        @param &present Máscara de canales presentes en la trama.
+        @param index Índice en el registro del canal 0 de este driver.
+    */
+    static void encode(uint8_t*& frame, uint16_t& present, uint8_t index) {
+        for (uint8_t ch = 0; ch < Head::CHANNELS; ch++) {
+            if (Head::reported(ch) && Series::count[ch] > 0) {
+                int32_t value = Head::hundredths(averageSum(Series::sum[ch], Series::count[ch]));
+                value = constrain(value, -32767L, 32767L);
+                *frame++ = lowByte((uint16_t)value);
+                *frame++ = highByte((uint16_t)value);
+                bitSet(present, index + ch);
+            }
+        }
+        Next::encode(frame, present, index + Head::CHANNELS);
+    }
+
+    /**
+        emptyMask() devuelve los bits HEALTH_EMPTY de los sensores cuyo canal principal (el 0)
+        no tuvo ninguna muestra válida desde la última transmisión.
+        @return Máscara de bits a combinar con sensorHealth.
+    */
+    static uint8_t emptyMask() {
+        uint8_t mask = Next::emptyMask();
+        if (Series::count[0] == 0) {
+            bitSet(mask, Head::HEALTH_EMPTY);
+        }
+        return mask;
+    }
+};
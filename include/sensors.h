@@ -7,110 +7,447 @@
 */
 
 /**
-    refreshAllSensors() se encarga de pedir el refresco de todos los sensores,
-    poniendo cada uno de los flags del vector refreshRequested en true.
-    Depende directamente del valor definido SENSORS_QTY (ver constants.h).
+    VoltageSensor es el driver del sensor de tensión (ver sensor_registry.h). Entrega cuatro canales:
+    { Tensión RMS, Frecuencia de línea, Factor de cresta, Distorsión }, obtenidos de las mismas
+    muestras, sin lecturas extra del ADC.
+    La medición no es bloqueante. Con EMON_SAMPLE_RATE distinto de 0, Timer1 dispara las conversiones
+    a frecuencia fija y la interrupción del ADC acumula exactamente EMON_CROSSINGS / 2 ciclos de
+    línea; read() sólo verifica si la ventana terminó. Si no, en cada llamado a read() se muestrea
+    la señal durante a lo sumo EMON_STEP_BUDGET microsegundos y se devuelve el control a loop(),
+    conservando los acumuladores de EmonLib hasta completar los EMON_CROSSINGS cruces; en ese caso
+    la frecuencia sólo se mide si la ventana entera entró en una pasada.
 */
-void refreshAllSensors() {
-    for (int i = 0; i < SENSORS_QTY; i++) {
-        refreshRequested[i] = true;
+struct VoltageSensor {
+    typedef float Sample;
+    static const uint8_t CHANNELS = 4;
+    static const int PERIOD = TENSION_PERIODO;
+    static const int PHASE = TENSION_FASE;
+    static const uint8_t HEALTH_EMPTY = HEALTH_TENSION_SIN_DATOS;
+
+    static bool read(Sample out[], uint8_t& valid) {
+        #ifndef TENSION_MOCK
+            if (!eMon.busy() && !eMon.ready()) {
+                // El ADC y Timer1 quedan para la ventana de tensión.
+                expansionPause();
+                eMon.begin(EMON_CROSSINGS, EMON_TIMEOUT);
+            }
+            eMon.step(EMON_STEP_BUDGET);
+            if (!eMon.ready()) {
+                return false;
+            }
+            expansionResume();
+            out[0] = eMon.result();
+            out[1] = eMon.frequency;
+            out[2] = eMon.crestFactor;
+            out[3] = eMon.distortion;
+            if (eMon.timedOut) {
+                // Una ventana incompleta no se promedia: sólo se reporta en health.
+                bitSet(sensorHealth, HEALTH_TENSION_TIMEOUT);
+                return true;
+            }
+            // Por software, una ventana repartida en varias pasadas de loop() pierde cruces: EmonLib
+            // no informa la frecuencia (0) y el canal no se promedia.
+            valid = eMon.frequency > 0 ? 0x0F : 0x0D;
+        #else
+            out[0] = TENSION_MOCK + random(300) / 100.0;
+            valid = 0x01;
+        #endif
+        #if DEBUG_LEVEL >= 3
+            Serial.print("Nueva tension: ");
+            Serial.println(out[0]);
+        #endif
+        return true;
+    }
+
+    static int32_t hundredths(Sample value) {
+        return (int32_t)(value * 100 + (value >= 0 ? 0.5 : -0.5));
+    }
+
+    static bool reported(uint8_t channel) {
+        return true;
     }
-    #if DEBUG_LEVEL >= 4
-        Serial.println("Refrescando sensores!");
+
+    static void name(uint8_t channel, String& rtn) {
+        static const char* const names[CHANNELS] = { "voltage", "frequency", "crest", "distortion" };
+        rtn += names[channel];
+    }
+};
+
+/**
+    applyTemperatureResolution() configura la resolución de todas las sondas conocidas.
+    Sólo accede al bus si la resolución cambió.
+    @param resolution Resolución deseada (9 a 12 bits).
+*/
+void applyTemperatureResolution(uint8_t resolution) {
+    if (resolution == temperatureResolution) {
+        return;
+    }
+    for (uint8_t i = 0; i < temperatureProbesFound; i++) {
+        sensorDS18B20.setResolution(temperatureProbes[i], resolution, true);
+    }
+    temperatureResolution = resolution;
+    #if DEBUG_LEVEL >= 3
+        Serial.print("Resolucion DS18B20: ");
+        Serial.println(resolution);
     #endif
 }
 
 /**
-    stopRefreshingAllSensors() se encarga de parar el refresco de todos los sensores,
-    poniendo cada uno de los flags del vector refreshRequested en false.
-    Depende directamente del valor definido SENSORS_QTY (ver constants.h).
+    chooseTemperatureResolution() elige la resolución de la próxima conversión:
+        - TEMPERATURA_RES_MAX si la temperatura está a menos de TEMPERATURA_MARGEN de un umbral de alerta,
+        - 11 bits si varió al menos TEMPERATURA_DELTA_RAPIDO desde la medición anterior,
+        - 10 bits si varió al menos TEMPERATURA_DELTA_LENTO,
+        - TEMPERATURA_RES_MIN si está estable.
+    La comparación se hace en cuentas crudas (ver TEMPERATURA_RAW), sin aritmética de punto flotante.
+    @param temperature Temperatura recién medida (en 1/128 °C).
+    @param previous Temperatura medida en la conversión anterior (en 1/128 °C).
+    @return Resolución sugerida para esta sonda.
 */
-void stopRefreshingAllSensors() {
-    for (int i = 0; i < SENSORS_QTY; i++) {
-        refreshRequested[i] = false;
+uint8_t chooseTemperatureResolution(int16_t temperature, int16_t previous) {
+    int16_t delta = abs(temperature - previous);
+    if (temperature >= TEMPERATURA_RAW(TEMPERATURA_UMBRAL_ALTO - TEMPERATURA_MARGEN)
+        || temperature <= TEMPERATURA_RAW(TEMPERATURA_UMBRAL_BAJO + TEMPERATURA_MARGEN)) {
+        return TEMPERATURA_RES_MAX;
+    } else if (delta >= TEMPERATURA_RAW(TEMPERATURA_DELTA_RAPIDO)) {
+        return 11;
+    } else if (delta >= TEMPERATURA_RAW(TEMPERATURA_DELTA_LENTO)) {
+        return 10;
     }
-    #if DEBUG_LEVEL >= 4
-        Serial.println("Abandonando refrescos!");
-    #endif
+    return TEMPERATURA_RES_MIN;
 }
 
 /**
-    getNewVoltage() se encarga de agregar un nuevo valor en el array de medición de tensión.
-    Luego de hacerlo, baja el flag correspondiente en refreshRequested.
+    discoverTemperatureProbes() recorre una única vez el bus OneWire y guarda las direcciones ROM
+    de hasta TEMPERATURA_PROBES sondas DS18B20, con las que inicializa la librería (alimentación
+    parásita y resolución). Si TEMPERATURA_ROM_EEPROM es TRUE, las persiste en EEPROM (sólo se
+    escriben los bytes que hayan cambiado).
+    @return Cantidad de sondas encontradas.
 */
+uint8_t discoverTemperatureProbes() {
+    temperatureProbesFound = 0;
+    // Las sondas nuevas pueden tener cualquier resolución: se fuerza a reconfigurarlas.
+    temperatureResolution = 0;
+    oneWire.reset_search();
+    while (temperatureProbesFound < TEMPERATURA_PROBES && oneWire.search(temperatureProbes[temperatureProbesFound])) {
+        if (sensorDS18B20.validAddress(temperatureProbes[temperatureProbesFound])
+            && sensorDS18B20.validFamily(temperatureProbes[temperatureProbesFound])) {
+            temperatureProbesFound++;
+        }
+    }
+    // Detecta la alimentación parásita de las sondas encontradas, sin volver a recorrer el bus.
+    sensorDS18B20.begin(temperatureProbes, temperatureProbesFound);
+    #if TEMPERATURA_ROM_EEPROM == TRUE
+        if (temperatureProbesFound > 0) {
+            EEPROM.update(TEMPERATURA_ROM_EEPROM_ADDR, temperatureProbesFound);
+            for (uint8_t i = 0; i < temperatureProbesFound; i++) {
+                EEPROM.put(TEMPERATURA_ROM_EEPROM_ADDR + 1 + i * sizeof(DeviceAddress), temperatureProbes[i]);
+            }
+        }
+    #endif
+    #if DEBUG_LEVEL >= 2
+        Serial.print("Sondas DS18B20 descubiertas: ");
+        Serial.println(temperatureProbesFound);
+    #endif
+    return temperatureProbesFound;
+}
 
-void getNewVoltage() {
-    float newVoltage = 0.0;
-    if (index < ARRAY_SIZE) {
-        #ifndef TENSION_MOCK
-            eMon.calcVI(EMON_CROSSINGS, EMON_TIMEOUT);
-            newVoltage = eMon.Vrms;
-        #else
-            newVoltage = TENSION_MOCK + random(300) / 100.0;
-        #endif
-        voltages[index] = newVoltage;
-        #if DEBUG_LEVEL >= 3
-            Serial.print("Nueva tension: ");
-            Serial.println(newVoltage);
+/**
+    setupTemperatureProbes() inicializa a los DS18B20.
+    Si TEMPERATURA_ROM_EEPROM es TRUE y la EEPROM contiene direcciones ROM válidas (CRC correcto)
+    de sondas que responden en el bus, se utilizan directamente, evitando la enumeración completa
+    del bus. Si no, enumera el bus y descubre las sondas. En ambos casos se inicializa la librería
+    con las sondas conocidas, que verifica si alguna usa alimentación parásita.
+    Las conversiones quedan configuradas como no bloqueantes y en TEMPERATURA_RES_MIN.
+*/
+void setupTemperatureProbes() {
+    #if defined(TEMPERATURA_PIN) && !defined(TEMPERATURA_MOCK)
+        // Las conversiones se esperan desde getNewTemperature(), sin bloquear.
+        sensorDS18B20.setWaitForConversion(false);
+        // La resolución cambia seguido: no se copia a la EEPROM de las sondas.
+        sensorDS18B20.setAutoSaveScratchPad(false);
+        #if TEMPERATURA_ROM_EEPROM == TRUE
+            uint8_t stored = EEPROM.read(TEMPERATURA_ROM_EEPROM_ADDR);
+            if (stored > 0 && stored <= TEMPERATURA_PROBES) {
+                uint8_t i = 0;
+                for (; i < stored; i++) {
+                    EEPROM.get(TEMPERATURA_ROM_EEPROM_ADDR + 1 + i * sizeof(DeviceAddress), temperatureProbes[i]);
+                    if (!sensorDS18B20.validAddress(temperatureProbes[i]) || !sensorDS18B20.validFamily(temperatureProbes[i])
+                        || !sensorDS18B20.isConnected(temperatureProbes[i])) {
+                        break;
+                    }
+                }
+                if (i == stored) {
+                    // Detecta la alimentación parásita de las sondas conocidas, sin recorrer el bus.
+                    sensorDS18B20.begin(temperatureProbes, stored);
+                    temperatureProbesFound = stored;
+                    #if DEBUG_LEVEL >= 2
+                        Serial.println("Sondas DS18B20 recuperadas de EEPROM.");
+                    #endif
+                }
+            }
         #endif
-    }
-    refreshRequested[0] = false;
+        if (temperatureProbesFound == 0) {
+            discoverTemperatureProbes();
+        }
+        applyTemperatureResolution(TEMPERATURA_RES_MIN);
+    #endif
 }
 
 /**
-    getNewTemperature() se encarga de agregar un nuevo valor en el array de medición de temperatura.
-    Luego de hacerlo, baja el flag correspondiente en refreshRequested.
+    TemperatureSensor es el driver de las sondas DS18B20 (ver sensor_registry.h). Entrega un canal
+    por sonda, en el orden de temperatureProbes. read() no bloquea a loop():
+        - en el primer llamado, emite un único Convert T con skip-ROM para todas las sondas a la vez
+        (el tiempo de conversión es el mismo que con una sola sonda) y vuelve,
+        - en los siguientes, espera el tiempo de conversión de la resolución actual y luego lee el
+        scratchpad de cada sonda por su dirección ROM ya conocida (ver temperatureProbes).
+    Sólo se vuelve a recorrer el bus cuando alguna lectura falla por CRC o desconexión, y entonces
+    se reinicia el filtro de mediana de todos los canales (ver restartFilter()). Una lectura
+    fallida no se marca como válida. Al finalizar, ajusta la resolución de la próxima conversión
+    (ver chooseTemperatureResolution()).
+    Las muestras son las cuentas crudas del DS18B20 (1/128 °C): se almacenan y promedian como
+    enteros y sólo al componer el payload se pasan a centésimas de °C.
+    La primera sonda siempre se reporta como "temperature"; las demás sólo si fueron descubiertas,
+    como "temperature2", "temperature3", etc.
 */
-void getNewTemperature() {
-    float newTemperature = 0.0;
-    if (index < ARRAY_SIZE) {
+struct TemperatureSensor {
+    typedef int16_t Sample;
+    static const uint8_t CHANNELS = TEMPERATURA_PROBES;
+    static const int PERIOD = TEMPERATURA_PERIODO;
+    static const int PHASE = TEMPERATURA_FASE;
+    static const uint8_t HEALTH_EMPTY = HEALTH_TEMPERATURA_SIN_DATOS;
+
+    static bool read(Sample out[], uint8_t& valid) {
         #ifndef TEMPERATURA_MOCK
-            sensorDS18B20.requestTemperatures();
-            newTemperature = sensorDS18B20.getTempCByIndex(0);
+            if (!temperatureConverting) {
+                if (temperatureProbesFound == 0) {
+                    // Las sondas redescubiertas pueden ser otras o estar en otro orden: cada canal
+                    // arranca el filtro de mediana de cero.
+                    SensorSeries<TemperatureSensor>::restartFilter();
+                    if (discoverTemperatureProbes() == 0) {
+                        bitSet(sensorHealth, HEALTH_TEMPERATURA_FALLA);
+                        return true;
+                    }
+                }
+                sensorDS18B20.requestTemperatures();
+                temperatureConversionStart = millis();
+                temperatureConverting = true;
+                return false;
+            }
+            if (millis() - temperatureConversionStart < (unsigned long)sensorDS18B20.millisToWaitForConversion(temperatureResolution)) {
+                return false;
+            }
+            temperatureConverting = false;
+
+            uint8_t probes = temperatureProbesFound;
+            uint8_t resolution = TEMPERATURA_RES_MIN;
+            for (uint8_t i = 0; i < probes; i++) {
+                out[i] = sensorDS18B20.getTemp(temperatureProbes[i]);
+                if (out[i] <= DEVICE_DISCONNECTED_RAW) {
+                    bitSet(sensorHealth, HEALTH_TEMPERATURA_FALLA);
+                    temperatureProbesFound = 0;
+                    continue;
+                }
+                resolution = max(resolution, chooseTemperatureResolution(out[i], previousTemperatures[i]));
+                previousTemperatures[i] = out[i];
+                bitSet(valid, i);
+                #if DEBUG_LEVEL >= 3
+                    Serial.print("Nueva temperatura (sonda ");
+                    Serial.print(i);
+                    Serial.print("): ");
+                    Serial.print(out[i]);
+                    Serial.println("/128");
+                #endif
+            }
+            if (temperatureProbesFound > 0) {
+                applyTemperatureResolution(resolution);
+            }
         #else
-            newTemperature = TEMPERATURA_MOCK + random(300) / 100.0;
+            out[0] = TEMPERATURA_RAW(TEMPERATURA_MOCK) + random(TEMPERATURA_RAW(3));
+            valid = 0x01;
+            #if DEBUG_LEVEL >= 3
+                Serial.print("Nueva temperatura: ");
+                Serial.print(out[0]);
+                Serial.println("/128");
+            #endif
         #endif
-        temperatures[index] = newTemperature;
+        return true;
     }
-    #if DEBUG_LEVEL >= 3
-        Serial.print("Nueva temperatura: ");
-        Serial.println(newTemperature);
+
+    static int32_t hundredths(Sample value) {
+        // 1/128 °C a centésimas de °C, redondeando al más cercano.
+        int32_t scaled = (int32_t)value * 100;
+        scaled += value >= 0 ? TEMPERATURA_RAW(1) / 2 : -TEMPERATURA_RAW(1) / 2;
+        return scaled / TEMPERATURA_RAW(1);
+    }
+
+    static bool reported(uint8_t channel) {
+        return channel == 0 || channel < temperatureProbesFound;
+    }
+
+    static void name(uint8_t channel, String& rtn) {
+        rtn += "temperature";
+        if (channel > 0) {
+            rtn += (channel + 1);
+        }
+    }
+};
+
+/**
+    ExpansionSensor es el driver del puerto de expansión (ver sensor_registry.h y expansion.h).
+    Entrega un canal por entrada (A3 a A7); sólo se reportan los habilitados en EXPANSION_MASK,
+    con el nombre de EXPANSION_NOMBRES. read() no espera: toma el promedio (en cuentas del ADC)
+    que acumuló la interrupción desde la lectura anterior. Se reporta en centésimas de volt.
+*/
+struct ExpansionSensor {
+    typedef int16_t Sample;
+    static const uint8_t CHANNELS = EXPANSION_CHANNELS;
+    static const int PERIOD = EXPANSION_PERIODO;
+    static const int PHASE = EXPANSION_FASE;
+    static const uint8_t HEALTH_EMPTY = HEALTH_EXPANSION_SIN_DATOS;
+
+    static bool read(Sample out[], uint8_t& valid) {
+        for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+            if (!bitRead(EXPANSION_MASK, ch)) {
+                continue;
+            }
+            noInterrupts();
+            uint32_t sum = expansionSums[ch];
+            uint16_t count = expansionCounts[ch];
+            expansionSums[ch] = 0;
+            expansionCounts[ch] = 0;
+            interrupts();
+            if (count > 0) {
+                out[ch] = (sum + count / 2) / count;
+                bitSet(valid, ch);
+            }
+        }
+        return true;
+    }
+
+    static int32_t hundredths(Sample value) {
+        // Cuentas del ADC a centésimas de volt, redondeando al más cercano.
+        return ((int32_t)value * EXPANSION_VREF_MV + 5120) / 10240;
+    }
+
+    static bool reported(uint8_t channel) {
+        return bitRead(EXPANSION_MASK, channel);
+    }
+
+    static void name(uint8_t channel, String& rtn) {
+        static const char* const names[CHANNELS] = EXPANSION_NOMBRES;
+        rtn += names[channel];
+    }
+};
+
+/**
+    Sensors es el registro de todos los sensores del nodo, en el orden en que se reportan.
+    Para agregar un sensor, basta con escribir su driver y sumarlo a esta lista.
+    El puerto de expansión sólo se registra si tiene algún canal habilitado.
+*/
+#if EXPANSION_MASK
+    typedef SensorRegistry<VoltageSensor, TemperatureSensor, ExpansionSensor> Sensors;
+#else
+    typedef SensorRegistry<VoltageSensor, TemperatureSensor> Sensors;
+#endif
+
+/**
+    setupInputInterrupts() habilita la interrupción por cambio de pin (PCINT) de PUERTA_PIN
+    y de ANTIPANICO_PIN, de modo que ningún flanco se pierda por más que loop() se demore.
+*/
+void setupInputInterrupts() {
+    #ifndef PUERTA_MOCK
+        *digitalPinToPCMSK(PUERTA_PIN) |= bit(digitalPinToPCMSKbit(PUERTA_PIN));
+        PCICR |= bit(digitalPinToPCICRbit(PUERTA_PIN));
+    #endif
+    #ifndef ANTIPANICO_MOCK
+        *digitalPinToPCMSK(ANTIPANICO_PIN) |= bit(digitalPinToPCMSKbit(ANTIPANICO_PIN));
+        PCICR |= bit(digitalPinToPCICRbit(ANTIPANICO_PIN));
     #endif
-    refreshRequested[1] = false;
 }
 
 /**
-    emergencyObserver() se encarga de pollear el estado del pin del botón antipánico,
-    almacenando el valor en un flag, emergency.
+    Rutina de interrupción por cambio de pin del puerto de las entradas.
+    Registra el instante del flanco en la entrada que cambió (el antirrebote se resuelve en los
+    observers) y, si la puerta quedó abierta o el botón antipánico presionado, enclava el evento.
+*/
+ISR(INPUTS_PCINT_vect) {
+    static uint8_t previousDoor = HIGH;
+    static uint8_t previousEmergency = HIGH;
+    unsigned long now = millis();
+
+    uint8_t door = digitalRead(PUERTA_PIN);
+    if (door != previousDoor) {
+        previousDoor = door;
+        doorEdgeMillis = now;
+        doorEdgePending = true;
+        if (door == PUERTA_ABIERTA) {
+            doorOpenedLatched = true;
+        }
+    }
+
+    uint8_t button = digitalRead(ANTIPANICO_PIN);
+    if (button != previousEmergency) {
+        previousEmergency = button;
+        emergencyEdgeMillis = now;
+        emergencyEdgePending = true;
+        if (button == ANTIPANICO_ACTIVO) {
+            emergencyLatched = true;
+        }
+    }
+}
+
+/**
+    debouncedEdge() indica si una entrada tuvo un flanco y ya pasaron INPUTS_DEBOUNCE_MS desde
+    el último, en cuyo caso baja el flag de flanco pendiente para que su nivel se lea una sola vez.
+    @param &pending Flag de flanco pendiente de la entrada.
+    @param &edgeMillis Instante del último flanco de la entrada.
+    @return true si hay que leer el nuevo nivel de la entrada.
+*/
+bool debouncedEdge(volatile bool& pending, volatile unsigned long& edgeMillis) {
+    bool settled = false;
+    noInterrupts();
+    if (pending && millis() - edgeMillis >= INPUTS_DEBOUNCE_MS) {
+        pending = false;
+        settled = true;
+    }
+    interrupts();
+    return settled;
+}
+
+/**
+    emergencyObserver() se encarga de actualizar el flag emergency a partir de los eventos
+    registrados por la interrupción: emergency es true mientras el botón antipánico esté
+    presionado (nivel sin rebotes) o mientras la emergencia siga enclavada sin reportar.
 */
 void emergencyObserver() {
     #ifndef ANTIPANICO_MOCK
-        if (digitalRead(ANTIPANICO_PIN) == ANTIPANICO_ACTIVO) { 
-            #if DEBUG_LEVEL >= 3
-                if (!emergency) {
-                    Serial.println("Emergencia detectada! ");
-                }
-            #endif
-            emergency = true;
-        } else {
-            #if DEBUG_LEVEL >= 3
-                if (emergency) {
-                    Serial.println("Emergencia finalizada. ");
-                }
-            #endif
-            emergency = false;
+        static bool pressed = false;
+        if (debouncedEdge(emergencyEdgePending, emergencyEdgeMillis)) {
+            pressed = digitalRead(ANTIPANICO_PIN) == ANTIPANICO_ACTIVO;
         }
+        bool newEmergency = pressed || emergencyLatched;
+        #if DEBUG_LEVEL >= 3
+            if (newEmergency && !emergency) {
+                Serial.println("Emergencia detectada! ");
+            } else if (!newEmergency && emergency) {
+                Serial.println("Emergencia finalizada. ");
+            }
+        #endif
+        emergency = newEmergency;
     #else
         emergency = ANTIPANICO_MOCK;
     #endif
 }
 
 /**
-    doorObserver() se encarga de pollear el estado del pin del 
-    sensor de puerta, almacenando ese valor en un flag, doorOpen.
+    doorObserver() se encarga de actualizar el flag doorOpen con el nivel sin rebotes del
+    sensor de puerta, sólo cuando la interrupción registró un flanco.
 */
 void doorObserver() {
     #ifndef PUERTA_MOCK
+        if (!debouncedEdge(doorEdgePending, doorEdgeMillis)) {
+            return;
+        }
         if (digitalRead(PUERTA_PIN) == PUERTA_ABIERTA) {
             if (!doorOpen) {
                 doorOpen = true;
@@ -129,4 +466,4 @@ void doorObserver() {
     #else
         doorOpen = PUERTA_MOCK;
     #endif
-}
\ No newline at end of file
+}
@@ -0,0 +1,113 @@
+/**
+    Header que contiene el agendado por slots (TDMA) de los reportes LoRa.
+    @file tdma.h
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+/*
+    El tiempo se divide en tramas de LORA_TIMEOUT segundos, y cada trama en LORA_TDMA_SLOTS slots.
+    El concentrador marca el inicio de cada trama con un beacon en broadcast ("<BROADCAST_ID>sync"),
+    que ocupa el slot 0; cada nodo reporta en el slot 1 + DEVICE_ID % (LORA_TDMA_SLOTS - 1), tras
+    una guarda de LORA_TDMA_GUARD ms. Con IDs consecutivos, hasta LORA_TDMA_SLOTS - 1 nodos por
+    canal transmiten sin colisionar entre sí.
+    El inicio de la trama se toma del instante de la interrupción RX_DONE del beacon, menos su
+    tiempo en el aire. Con cada beacon se corrige la fase y se estima la deriva del oscilador del
+    nodo (en us por trama), de modo que entre beacons las tramas se siguen con la duración corregida.
+    Hasta recibir el primer beacon, o luego de LORA_TDMA_HOLDOVER tramas sin beacons, se vuelve a
+    reportar cada LORA_TIMEOUT segundos sin coordinación (ALOHA).
+*/
+
+#define LORA_TDMA_FRAME_MS sec2ms(LORA_TIMEOUT)                    // Duración nominal de la trama (en ms).
+#define LORA_TDMA_SLOT_MS (LORA_TDMA_FRAME_MS / LORA_TDMA_SLOTS)    // Duración de cada slot (en ms).
+#define LORA_TDMA_SLOT (1 + DEVICE_ID % (LORA_TDMA_SLOTS - 1))      // Slot de este nodo.
+
+/**
+    tdmaAdvance() avanza tdmaFrameStart por las tramas que hayan transcurrido, con la duración
+    corregida por la deriva estimada. Si pasan LORA_TDMA_HOLDOVER tramas sin beacon, pierde la
+    sincronización.
+*/
+void tdmaAdvance() {
+    while (tdmaSynced) {
+        long frameUs = (long)LORA_TDMA_FRAME_MS * 1000 + tdmaDrift + tdmaRemainder;
+        if (millis() - tdmaFrameStart < (unsigned long)(frameUs / 1000)) {
+            return;
+        }
+        tdmaFrameStart += frameUs / 1000;
+        tdmaRemainder = frameUs % 1000;
+        tdmaFrame++;
+        if (++tdmaFramesSinceBeacon >= LORA_TDMA_HOLDOVER) {
+            tdmaSynced = false;
+            #if DEBUG_LEVEL >= 1
+                Serial.println("TDMA sin beacon, reportes sin coordinar!");
+            #endif
+        }
+    }
+}
+
+/**
+    tdmaBeacon() sincroniza las tramas con un beacon del concentrador y actualiza la deriva estimada.
+    @param rxTime Valor de millis() en la interrupción RX_DONE del beacon.
+    @param length Longitud del beacon (en bytes).
+*/
+void tdmaBeacon(unsigned long rxTime, uint8_t length) {
+    unsigned long start = rxTime - LoRa.timeOnAir(length);
+
+    if (!tdmaSynced) {
+        tdmaSynced = true;
+        tdmaUplinkFrame = tdmaFrame - 1;
+    } else {
+        tdmaAdvance();
+        // Error de fase respecto de la trama prevista; si el beacon llegó antes de que el nodo
+        // avanzara la trama (oscilador lento), abre la trama siguiente.
+        long error = (long)(start - tdmaFrameStart);
+        if (error > (long)LORA_TDMA_FRAME_MS / 2) {
+            error -= LORA_TDMA_FRAME_MS;
+            tdmaFrame++;
+        }
+        // La mitad del error por trama corrige la deriva (filtro de primer orden).
+        long frames = max(tdmaFramesSinceBeacon, 1);
+        tdmaDrift = constrain(tdmaDrift + error * 1000 / frames / 2, -LORA_TDMA_MAX_DRIFT, LORA_TDMA_MAX_DRIFT);
+        #if DEBUG_LEVEL >= 2
+            Serial.print("TDMA: error=");
+            Serial.print(error);
+            Serial.print(" ms, deriva=");
+            Serial.print(tdmaDrift);
+            Serial.println(" us/trama");
+        #endif
+    }
+
+    tdmaFrameStart = start;
+    tdmaRemainder = 0;
+    tdmaFramesSinceBeacon = 0;
+}
+
+/**
+    tdmaUplinkDue() indica si es momento de reportar: una vez por trama, al comienzo del slot del
+    nodo (o cada LORA_TIMEOUT segundos, sin sincronización). Si loop() llegó tarde al slot, más
+    de LORA_TDMA_WINDOW ms, saltea la trama para no invadir el slot siguiente.
+    @return true si hay que reportar ahora.
+*/
+bool tdmaUplinkDue() {
+    #if LORA_TDMA == TRUE
+        tdmaAdvance();
+        if (tdmaSynced) {
+            unsigned long elapsed = millis() - tdmaFrameStart;
+            unsigned long slotStart = LORA_TDMA_SLOT * LORA_TDMA_SLOT_MS + LORA_TDMA_GUARD;
+            // El desfasaje dentro de la trama también se corrige por la deriva.
+            slotStart += (long)slotStart * (tdmaDrift / 1000) / (long)LORA_TDMA_FRAME_MS;
+            if (tdmaFrame != tdmaUplinkFrame && elapsed >= slotStart) {
+                tdmaUplinkFrame = tdmaFrame;
+                if (elapsed < slotStart + LORA_TDMA_WINDOW) {
+                    return true;
+                }
+                #if DEBUG_LEVEL >= 1
+                    Serial.println("Slot TDMA perdido!");
+                #endif
+            }
+            return false;
+        }
+    #endif
+    return runEvery(sec2ms(LORA_TIMEOUT), 1);
+}
@@ -77,6 +77,7 @@ void DallasTemperature::setOneWire(OneWire* _oneWire) {
 	bitResolution = 9;
 	waitForConversion = true;
 	checkForConversion = true;
+	autoSaveScratchPad = true;
 
 }
 
@@ -90,18 +91,37 @@ void DallasTemperature::begin(void) {
 	ds18Count = 0; // Reset number of DS18xxx Family devices
 
 	while (_wire->search(deviceAddress)) {
+		addDevice(deviceAddress);
+	}
 
-		if (validAddress(deviceAddress)) {
+}
 
-			if (!parasite && readPowerSupply(deviceAddress))
-				parasite = true;
+// initialises the bus like begin(), but with the addresses of the devices
+// already known (e.g. stored in EEPROM): only the ROM search is skipped
+void DallasTemperature::begin(const DeviceAddress* deviceAddresses, uint8_t count) {
 
-			bitResolution = max(bitResolution, getResolution(deviceAddress));
+	devices = 0;
+	ds18Count = 0;
 
-			devices++;
-			if (validFamily(deviceAddress)) {
-				ds18Count++;
-			}
+	for (uint8_t i = 0; i < count; i++) {
+		addDevice(deviceAddresses[i]);
+	}
+
+}
+
+// counts a device found on the bus, and checks its power supply and resolution
+void DallasTemperature::addDevice(const uint8_t* deviceAddress) {
+
+	if (validAddress(deviceAddress)) {
+
+		if (!parasite && readPowerSupply(deviceAddress))
+			parasite = true;
+
+		bitResolution = max(bitResolution, getResolution(deviceAddress));
+
+		devices++;
+		if (validFamily(deviceAddress)) {
+			ds18Count++;
 		}
 	}
 
@@ -202,6 +222,10 @@ void DallasTemperature::writeScratchPad(const uint8_t* deviceAddress,
 
 	_wire->reset();
 
+	// skip the EEPROM copy (and its 20 ms wait) for settings that change often
+	if (!autoSaveScratchPad)
+		return;
+
 	// save the newly written values to eeprom
 	_wire->select(deviceAddress);
 	_wire->write(COPYSCRATCH, parasite);
@@ -354,6 +378,19 @@ bool DallasTemperature::getCheckForConversion() {
 	return checkForConversion;
 }
 
+// sets the value of the autoSaveScratchPad flag
+// TRUE : writeScratchPad() also copies the scratchpad to the device's EEPROM
+// FALSE: writeScratchPad() only writes the scratchpad (lost on power cycle),
+//        sparing the EEPROM wear and the 20 ms wait
+void DallasTemperature::setAutoSaveScratchPad(bool flag) {
+	autoSaveScratchPad = flag;
+}
+
+// gets the value of the autoSaveScratchPad flag
+bool DallasTemperature::getAutoSaveScratchPad() {
+	return autoSaveScratchPad;
+}
+
 bool DallasTemperature::isConversionComplete() {
 	uint8_t b = _wire->read_bit();
 	return (b == 1);
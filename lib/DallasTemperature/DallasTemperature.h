@@ -46,6 +46,9 @@ public:
 	// initialise bus
 	void begin(void);
 
+	// initialise bus with already known device addresses (no ROM search)
+	void begin(const DeviceAddress*, uint8_t);
+
 	// returns the number of devices found on the bus
 	uint8_t getDeviceCount(void);
 
@@ -98,6 +101,10 @@ public:
 	void setCheckForConversion(bool);
 	bool getCheckForConversion(void);
 
+	// sets/gets the autoSaveScratchPad flag
+	void setAutoSaveScratchPad(bool);
+	bool getAutoSaveScratchPad(void);
+
 	// sends command for all devices on the bus to perform a temperature conversion
 	void requestTemperatures(void);
 
@@ -221,6 +228,9 @@ private:
 	// used to requestTemperature to dynamically check if a conversion is complete
 	bool checkForConversion;
 
+	// used to writeScratchPad with or without copying it to the device's EEPROM
+	bool autoSaveScratchPad;
+
 	// count of devices on the bus
 	uint8_t devices;
 
@@ -235,6 +245,9 @@ private:
 
 	void blockTillConversionComplete(uint8_t);
 
+	// counts a valid device, checking its power supply and resolution
+	void addDevice(const uint8_t*);
+
 #if REQUIRESALARMS
 
 	// required for alarmSearch
@@ -18,6 +18,10 @@
 #include "WProgram.h"
 #endif
 
+#if defined(__AVR__)
+#include <avr/sleep.h>
+#endif
+
 
 //--------------------------------------------------------------------------------------
 // Sets the pins to be used for voltage and current sensors
@@ -27,7 +31,8 @@ void EnergyMonitor::voltage(unsigned int _inPinV, double _VCAL, double _PHASECAL
   inPinV = _inPinV;
   VCAL = _VCAL;
   PHASECAL = _PHASECAL;
-  offsetV = ADC_COUNTS>>1;
+  adcCountsV = ADC_COUNTS << overBitsV;
+  offsetV = adcCountsV>>1;
 }
 
 void EnergyMonitor::current(unsigned int _inPinI, double _ICAL)
@@ -45,7 +50,88 @@ void EnergyMonitor::voltageTX(double _VCAL, double _PHASECAL)
   inPinV = 2;
   VCAL = _VCAL;
   PHASECAL = _PHASECAL;
-  offsetV = ADC_COUNTS>>1;
+  adcCountsV = ADC_COUNTS << overBitsV;
+  offsetV = adcCountsV>>1;
+}
+
+//--------------------------------------------------------------------------------------
+// Sets oversampling of the voltage channel (0 to 3 extra bits)
+//--------------------------------------------------------------------------------------
+void EnergyMonitor::voltageOversampling(unsigned int bits, bool noiseSleep)
+{
+  overBitsV = (bits > 3) ? 3 : bits;
+  noiseSleepV = noiseSleep;
+  adcCountsV = ADC_COUNTS << overBitsV;
+  offsetV = adcCountsV>>1;
+}
+
+//--------------------------------------------------------------------------------------
+// Sets timer-triggered sampling of the voltage channel (0 = software paced)
+//--------------------------------------------------------------------------------------
+#if defined(__AVR__) && defined(TIMER1_COMPB_vect)
+#define EMON_TS_MAX_SAMPLES 4000                   //Keeps the sum of squares within 32 bits
+#define EMON_TS_HYSTERESIS 4                       //Counts around midV before a crossing counts
+EnergyMonitor* EnergyMonitor::timerMonitor = 0;
+void (*EnergyMonitor::idleHandler)(int) = 0;
+#endif
+
+void EnergyMonitor::voltageTimerSampling(unsigned int rate, unsigned int mainsHz)
+{
+  #if defined(__AVR__) && defined(TIMER1_COMPB_vect)
+  sampleRate = rate;
+  samplesPerCycle = (rate && mainsHz) ? rate / mainsHz : 0;
+  midV = ADC_COUNTS>>1;
+  tsDone = true;                                   //No window yet: conversions go to idleHandler
+  timerMonitor = rate ? this : 0;
+  #else
+  sampleRate = 0;
+  #endif
+}
+
+//--------------------------------------------------------------------------------------
+// Sets the handler of the conversions outside a voltage window
+//--------------------------------------------------------------------------------------
+void EnergyMonitor::attachIdleADC(void (*handler)(int))
+{
+  #if defined(__AVR__) && defined(TIMER1_COMPB_vect)
+  idleHandler = handler;
+  #endif
+}
+
+//--------------------------------------------------------------------------------------
+// Reads one (oversampled and decimated) voltage sample
+//--------------------------------------------------------------------------------------
+int EnergyMonitor::readV()
+{
+  if (overBitsV == 0 && !noiseSleepV) return analogRead(inPinV);
+
+  //The first conversion also selects the channel.
+  unsigned long acc = analogRead(inPinV);
+  unsigned int conversions = 1 << (2 * overBitsV);
+  for (unsigned int n = 1; n < conversions; n++)
+  {
+    acc += noiseSleepV ? readSleepV() : analogRead(inPinV);
+  }
+  return acc >> overBitsV;
+}
+
+//--------------------------------------------------------------------------------------
+// Converts the already selected channel with the CPU in ADC noise reduction sleep
+//--------------------------------------------------------------------------------------
+int EnergyMonitor::readSleepV()
+{
+  #if defined(__AVR__)
+  ADCSRA |= _BV(ADIE);
+  set_sleep_mode(SLEEP_MODE_ADC);
+  sleep_enable();
+  sleep_cpu();                                     //Entering the sleep mode starts the conversion
+  sleep_disable();
+  while (bit_is_set(ADCSRA, ADSC));                //Another interrupt may have woken us up early
+  ADCSRA &= ~_BV(ADIE);
+  return ADC;
+  #else
+  return analogRead(inPinV);
+  #endif
 }
 
 void EnergyMonitor::currentTX(unsigned int _channel, double _ICAL)
@@ -62,98 +148,214 @@ void EnergyMonitor::currentTX(unsigned int _channel, double _ICAL)
 // Calculates realPower,apparentPower,powerFactor,Vrms,Irms,kWh increment
 // From a sample window of the mains AC voltage and current.
 // The Sample window length is defined by the number of half wavelengths or crossings we choose to measure.
+// Blocking wrapper around begin()/step(): runs the whole window in one call.
 //--------------------------------------------------------------------------------------
 void EnergyMonitor::calcVI(unsigned int crossings, unsigned int timeout)
+{
+  begin(crossings, timeout);
+  while (!ready()) step(0xFFFFFFFFUL);
+}
+
+//--------------------------------------------------------------------------------------
+// Arms a resumable measurement window. Nothing is sampled until step() is called.
+//--------------------------------------------------------------------------------------
+void EnergyMonitor::begin(unsigned int crossings, unsigned int timeout)
 {
   #if defined emonTxV3
-  int SupplyVoltage=3300;
+  SupplyVoltage=3300;
   #else
-  int SupplyVoltage = readVcc();
+  SupplyVoltage = readVcc();
   #endif
 
-  unsigned int crossCount = 0;                             //Used to measure number of times threshold is crossed.
-  unsigned int numberOfSamples = 0;                        //This is now incremented
+  targetCrossings = crossings;
+  timeoutMs = timeout;
+  crossCount = 0;
+  numberOfSamples = 0;
+  splitVI = false;
+  sumV = 0;
+  sumI = 0;
+  sumP = 0;
+  sumAbsV = 0;
+  peakV = 0;
 
-  //-------------------------------------------------------------------------------------------------------------------------
-  // 1) Waits for the waveform to be close to 'zero' (mid-scale adc) part in sin curve.
-  //-------------------------------------------------------------------------------------------------------------------------
-  unsigned long start = millis();    //millis()-start makes sure it doesnt get stuck in the loop if there is an error.
+  startMs = millis();    //millis()-start makes sure it doesnt get stuck in the loop if there is an error.
+  viState = VI_WAIT_START;
 
-  while(1)                                   //the while loop...
+  #if defined(__AVR__) && defined(TIMER1_COMPB_vect)
+  if (sampleRate)
   {
-    startV = analogRead(inPinV);                    //using the voltage waveform
-    if ((startV < (ADC_COUNTS*0.55)) && (startV > (ADC_COUNTS*0.45))) break;  //check its within range
-    if ((millis()-start)>timeout) break;
+    //A coherent window has no need to wait for a zero crossing.
+    unsigned long samples = (unsigned long)(crossings / 2) * samplesPerCycle;
+    startTimerVI(samples > EMON_TS_MAX_SAMPLES ? EMON_TS_MAX_SAMPLES : samples);
+    viState = VI_SAMPLING;
   }
+  #endif
+}
 
-  //-------------------------------------------------------------------------------------------------------------------------
-  // 2) Main measurement loop
-  //-------------------------------------------------------------------------------------------------------------------------
-  start = millis();
+//--------------------------------------------------------------------------------------
+// Processes samples of the armed window for at most budget_us microseconds.
+// Accumulators are kept in the object, so the window resumes on the next call.
+//--------------------------------------------------------------------------------------
+void EnergyMonitor::step(unsigned long budget_us)
+{
+  #if defined(__AVR__) && defined(TIMER1_COMPB_vect)
+  if (sampleRate)
+  {
+    //The interrupt does the sampling: only the post loop calculations are left.
+    if (viState == VI_SAMPLING && (tsDone || (millis()-startMs) > timeoutMs))
+    {
+      timedOut = !tsDone;
+      stopTimerVI();
+      finishTimerVI();
+      viState = VI_DONE;
+    }
+    return;
+  }
+  #endif
 
-  while ((crossCount < crossings) && ((millis()-start)<timeout))
+  unsigned long stepStart = micros();
+
+  while (viState == VI_WAIT_START || viState == VI_SAMPLING)
   {
-    numberOfSamples++;                       //Count number of times looped.
-    lastFilteredV = filteredV;               //Used for delay/phase compensation
-
-    //-----------------------------------------------------------------------------
-    // A) Read in raw voltage and current samples
-    //-----------------------------------------------------------------------------
-    sampleV = analogRead(inPinV);                 //Read in raw voltage signal
-    sampleI = analogRead(inPinI);                 //Read in raw current signal
-
-    //-----------------------------------------------------------------------------
-    // B) Apply digital low pass filters to extract the 2.5 V or 1.65 V dc offset,
-    //     then subtract this - signal is now centred on 0 counts.
-    //-----------------------------------------------------------------------------
-    offsetV = offsetV + ((sampleV-offsetV)/1024);
-    filteredV = sampleV - offsetV;
-    offsetI = offsetI + ((sampleI-offsetI)/1024);
-    filteredI = sampleI - offsetI;
+    if (viState == VI_WAIT_START)
+    {
+      //-------------------------------------------------------------------------------------------------------------------------
+      // 1) Waits for the waveform to be close to 'zero' (mid-scale adc) part in sin curve.
+      //-------------------------------------------------------------------------------------------------------------------------
+      startV = readV();                               //using the voltage waveform
+      if (((startV < (adcCountsV*0.55)) && (startV > (adcCountsV*0.45))) || ((millis()-startMs)>timeoutMs))
+      {
+        startMs = millis();
+        viState = VI_SAMPLING;
+      }
+    }
+    else if ((crossCount < targetCrossings) && ((millis()-startMs)<timeoutMs))
+    {
+      //-------------------------------------------------------------------------------------------------------------------------
+      // 2) Main measurement loop
+      //-------------------------------------------------------------------------------------------------------------------------
+      sampleVI();
+    }
+    else
+    {
+      timedOut = crossCount < targetCrossings;
+      finishVI();
+      viState = VI_DONE;
+    }
+
+    if ((micros()-stepStart) >= budget_us)
+    {
+      if (viState == VI_SAMPLING) splitVI = true;
+      break;
+    }
+  }
+}
 
-    //-----------------------------------------------------------------------------
-    // C) Root-mean-square method voltage
-    //-----------------------------------------------------------------------------
-    sqV= filteredV * filteredV;                 //1) square voltage values
-    sumV += sqV;                                //2) sum
-
-    //-----------------------------------------------------------------------------
-    // D) Root-mean-square method current
-    //-----------------------------------------------------------------------------
-    sqI = filteredI * filteredI;                //1) square current values
-    sumI += sqI;                                //2) sum
-
-    //-----------------------------------------------------------------------------
-    // E) Phase calibration
-    //-----------------------------------------------------------------------------
-    phaseShiftedV = lastFilteredV + PHASECAL * (filteredV - lastFilteredV);
-
-    //-----------------------------------------------------------------------------
-    // F) Instantaneous power calc
-    //-----------------------------------------------------------------------------
-    instP = phaseShiftedV * filteredI;          //Instantaneous Power
-    sumP +=instP;                               //Sum
-
-    //-----------------------------------------------------------------------------
-    // G) Find the number of times the voltage has crossed the initial voltage
-    //    - every 2 crosses we will have sampled 1 wavelength
-    //    - so this method allows us to sample an integer number of half wavelengths which increases accuracy
-    //-----------------------------------------------------------------------------
-    lastVCross = checkVCross;
-    if (sampleV > startV) checkVCross = true;
-                     else checkVCross = false;
-    if (numberOfSamples==1) lastVCross = checkVCross;
-
-    if (lastVCross != checkVCross) crossCount++;
+bool EnergyMonitor::ready()
+{
+  return viState == VI_DONE;
+}
+
+bool EnergyMonitor::busy()
+{
+  return viState == VI_WAIT_START || viState == VI_SAMPLING;
+}
+
+//--------------------------------------------------------------------------------------
+// Returns Vrms of the finished window and releases it, so a new begin() is needed.
+//--------------------------------------------------------------------------------------
+double EnergyMonitor::result()
+{
+  viState = VI_IDLE;
+  return Vrms;
+}
+
+void EnergyMonitor::cancel()
+{
+  #if defined(__AVR__) && defined(TIMER1_COMPB_vect)
+  if (sampleRate && viState == VI_SAMPLING) stopTimerVI();
+  #endif
+  viState = VI_IDLE;
+}
+
+void EnergyMonitor::sampleVI()
+{
+  numberOfSamples++;                       //Count number of times looped.
+  lastFilteredV = filteredV;               //Used for delay/phase compensation
+
+  //-----------------------------------------------------------------------------
+  // A) Read in raw voltage and current samples
+  //-----------------------------------------------------------------------------
+  sampleV = readV();                            //Read in raw voltage signal
+  sampleI = analogRead(inPinI);                 //Read in raw current signal
+
+  //-----------------------------------------------------------------------------
+  // B) Apply digital low pass filters to extract the 2.5 V or 1.65 V dc offset,
+  //     then subtract this - signal is now centred on 0 counts.
+  //-----------------------------------------------------------------------------
+  offsetV = offsetV + ((sampleV-offsetV)/1024);
+  filteredV = sampleV - offsetV;
+  offsetI = offsetI + ((sampleI-offsetI)/1024);
+  filteredI = sampleI - offsetI;
+
+  //-----------------------------------------------------------------------------
+  // C) Root-mean-square method voltage
+  //-----------------------------------------------------------------------------
+  sqV= filteredV * filteredV;                 //1) square voltage values
+  sumV += sqV;                                //2) sum
+
+  //-----------------------------------------------------------------------------
+  // C') Mean-absolute and peak for the waveform metrics
+  //-----------------------------------------------------------------------------
+  double absV = fabs(filteredV);
+  sumAbsV += absV;
+  if (absV > peakV) peakV = absV;
+
+  //-----------------------------------------------------------------------------
+  // D) Root-mean-square method current
+  //-----------------------------------------------------------------------------
+  sqI = filteredI * filteredI;                //1) square current values
+  sumI += sqI;                                //2) sum
+
+  //-----------------------------------------------------------------------------
+  // E) Phase calibration
+  //-----------------------------------------------------------------------------
+  phaseShiftedV = lastFilteredV + PHASECAL * (filteredV - lastFilteredV);
+
+  //-----------------------------------------------------------------------------
+  // F) Instantaneous power calc
+  //-----------------------------------------------------------------------------
+  instP = phaseShiftedV * filteredI;          //Instantaneous Power
+  sumP +=instP;                               //Sum
+
+  //-----------------------------------------------------------------------------
+  // G) Find the number of times the voltage has crossed the initial voltage
+  //    - every 2 crosses we will have sampled 1 wavelength
+  //    - so this method allows us to sample an integer number of half wavelengths which increases accuracy
+  //-----------------------------------------------------------------------------
+  lastVCross = checkVCross;
+  if (sampleV > startV) checkVCross = true;
+                   else checkVCross = false;
+  if (numberOfSamples==1) lastVCross = checkVCross;
+
+  if (lastVCross != checkVCross)
+  {
+    //Timestamp the crossings: (crossings - 1) half cycles span first..last.
+    lastCrossUs = micros();
+    if (crossCount == 0) firstCrossUs = lastCrossUs;
+    crossCount++;
   }
+}
 
+void EnergyMonitor::finishVI()
+{
   //-------------------------------------------------------------------------------------------------------------------------
   // 3) Post loop calculations
   //-------------------------------------------------------------------------------------------------------------------------
   //Calculation of the root of the mean of the voltage and current squared (rms)
   //Calibration coefficients applied.
 
-  double V_RATIO = VCAL *((SupplyVoltage/1000.0) / (ADC_COUNTS));
+  double V_RATIO = VCAL *((SupplyVoltage/1000.0) / (adcCountsV));
   Vrms = V_RATIO * sqrt(sumV / numberOfSamples);
 
   double I_RATIO = ICAL *((SupplyVoltage/1000.0) / (ADC_COUNTS));
@@ -164,13 +366,159 @@ void EnergyMonitor::calcVI(unsigned int crossings, unsigned int timeout)
   apparentPower = Vrms * Irms;
   powerFactor=realPower / apparentPower;
 
+  //Waveform quality, in raw ADC counts (calibration cancels out)
+  double rmsCounts = sqrt(sumV / numberOfSamples);
+  double meanAbsCounts = sumAbsV / numberOfSamples;
+  //Crossings in the gaps between step() calls are missed, so a split window reads low.
+  frequency = 0;
+  if (!splitVI && crossCount > 2 && lastCrossUs != firstCrossUs)
+    frequency = (crossCount - 1) * 500000.0 / (lastCrossUs - firstCrossUs);
+  crestFactor = (rmsCounts > 0) ? peakV / rmsCounts : 0;
+  distortion = 0;
+  if (meanAbsCounts > 0)
+  {
+    //A pure sine has a form factor (RMS / mean-absolute) of pi / (2 * sqrt(2)).
+    double ffRatio = (rmsCounts / meanAbsCounts) / 1.1107;
+    if (ffRatio > 1) distortion = sqrt(ffRatio * ffRatio - 1);
+  }
+
   //Reset accumulators
   sumV = 0;
   sumI = 0;
   sumP = 0;
+  sumAbsV = 0;
+  peakV = 0;
+//--------------------------------------------------------------------------------------
+}
+
+#if defined(__AVR__) && defined(TIMER1_COMPB_vect)
 //--------------------------------------------------------------------------------------
+// Starts Timer1 in CTC mode at sampleRate and lets compare B trigger the conversions.
+// One extra conversion is discarded: readVcc() just switched the reference.
+//--------------------------------------------------------------------------------------
+void EnergyMonitor::startTimerVI(unsigned int samples)
+{
+  uint8_t pin = inPinV >= 14 ? inPinV - 14 : inPinV;
+
+  tsDone = (samples == 0);
+  tsAbove = false;
+  tsDiscard = true;
+  tsRemaining = samples;
+  tsIndex = 0;
+  tsCrossCount = 0;
+  tsSum = 0;
+  tsSumSq = 0;
+  tsSumAbs = 0;
+  tsMin = ADC_COUNTS - 1;
+  tsMax = 0;
+  if (tsDone) return;
+
+  ADMUX = _BV(REFS0) | (pin & 0x07);              //AVcc reference, as analogRead()
+
+  TCCR1B = 0;
+  TCCR1A = 0;
+  TCNT1 = 0;
+  OCR1A = (F_CPU / 8) / sampleRate - 1;
+  OCR1B = OCR1A;
+  TIFR1 = _BV(OCF1B);
+
+  ADCSRB = (ADCSRB & ~(_BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0))) | _BV(ADTS2) | _BV(ADTS0);
+  ADCSRA |= _BV(ADIF) | _BV(ADATE) | _BV(ADIE);
+  TCCR1B = _BV(WGM12) | _BV(CS11);                 //CTC, clk/8
+}
+
+void EnergyMonitor::stopTimerVI()
+{
+  TCCR1B = 0;
+  ADCSRA &= ~(_BV(ADATE) | _BV(ADIE));
 }
 
+//--------------------------------------------------------------------------------------
+// ADC interrupt: accumulates one timer-triggered sample of the voltage window
+//--------------------------------------------------------------------------------------
+void EnergyMonitor::handleADC()
+{
+  EnergyMonitor* m = timerMonitor;
+  TIFR1 = _BV(OCF1B);                              //Re-arms the next compare B trigger
+  if (m == 0 || m->tsDone)
+  {
+    if (idleHandler) idleHandler(ADC);
+    return;
+  }
+
+  int s = ADC;
+  if (m->tsDiscard)
+  {
+    m->tsDiscard = false;
+    return;
+  }
+
+  m->tsSum += s;
+  m->tsSumSq += (unsigned long)s * s;
+  int v = s - m->midV;
+  m->tsSumAbs += v < 0 ? -v : v;
+  if (s < m->tsMin) m->tsMin = s;
+  if (s > m->tsMax) m->tsMax = s;
+
+  //Crossings of the previous mean with a small hysteresis, timestamped in samples.
+  if ((m->tsAbove && v < -EMON_TS_HYSTERESIS) || (!m->tsAbove && v > EMON_TS_HYSTERESIS))
+  {
+    m->tsAbove = !m->tsAbove;
+    if (m->tsIndex > 0)
+    {
+      if (m->tsCrossCount == 0) m->tsFirstCross = m->tsIndex;
+      m->tsLastCross = m->tsIndex;
+      m->tsCrossCount++;
+    }
+  }
+  m->tsIndex++;
+
+  if (--m->tsRemaining == 0)
+  {
+    ADCSRA &= ~_BV(ADATE);
+    m->tsDone = true;
+  }
+}
+
+//--------------------------------------------------------------------------------------
+// Post loop calculations of a timer-triggered window, in integer sums until the end
+//--------------------------------------------------------------------------------------
+void EnergyMonitor::finishTimerVI()
+{
+  unsigned int n = tsIndex;
+  Vrms = 0;
+  Irms = 0;
+  realPower = 0;
+  apparentPower = 0;
+  powerFactor = 0;
+  frequency = 0;
+  crestFactor = 0;
+  distortion = 0;
+  if (n == 0) return;
+
+  //Whole cycles: the mean is the DC offset, the variance is the AC power.
+  double mean = (double)tsSum / n;
+  double meanSq = (double)tsSumSq / n - mean * mean;
+  double rmsCounts = meanSq > 0 ? sqrt(meanSq) : 0;
+
+  double V_RATIO = VCAL *((SupplyVoltage/1000.0) / (ADC_COUNTS));
+  Vrms = V_RATIO * rmsCounts;
+
+  if (tsCrossCount > 2 && tsLastCross != tsFirstCross)
+    frequency = (tsCrossCount - 1) * (double)sampleRate / (2.0 * (tsLastCross - tsFirstCross));
+  double peak = max(tsMax - mean, mean - tsMin);
+  crestFactor = (rmsCounts > 0) ? peak / rmsCounts : 0;
+  double meanAbsCounts = (double)tsSumAbs / n;
+  if (meanAbsCounts > 0)
+  {
+    double ffRatio = (rmsCounts / meanAbsCounts) / 1.1107;
+    if (ffRatio > 1) distortion = sqrt(ffRatio * ffRatio - 1);
+  }
+
+  midV = (int)(mean + 0.5);
+}
+#endif
+
 //--------------------------------------------------------------------------------------
 double EnergyMonitor::calcIrms(unsigned int Number_of_Samples)
 {
@@ -261,3 +609,15 @@ long EnergyMonitor::readVcc() {
   #endif
 }
 
+#if defined(__AVR__)
+//--------------------------------------------------------------------------------------
+// Wakes the CPU from ADC noise reduction sleep (see readSleepV) and collects the
+// timer-triggered samples (see voltageTimerSampling)
+//--------------------------------------------------------------------------------------
+ISR(ADC_vect)
+{
+  #if defined(TIMER1_COMPB_vect)
+  EnergyMonitor::handleADC();
+  #endif
+}
+#endif
@@ -49,11 +49,45 @@ class EnergyMonitor
     void voltage(unsigned int _inPinV, double _VCAL, double _PHASECAL);
     void current(unsigned int _inPinI, double _ICAL);
 
+    // Oversampling and decimation of the voltage channel: each sample is the sum
+    // of 4^bits conversions shifted right by bits, i.e. 10+bits effective bits.
+    // With noiseSleep (AVR) the CPU sleeps in ADC noise reduction mode during each
+    // conversion; Timer0 is halted meanwhile, so millis() lags ~100 uS per conversion,
+    // and so is the UART (clkIO stops), so serial bytes arriving while asleep are lost.
+    // The 4^bits conversions are consecutive: from 2 bits on (16 conversions, ~1.8 mS
+    // at 50 Hz) each sample averages a slice of the waveform and Vrms reads low.
+    void voltageOversampling(unsigned int bits, bool noiseSleep = false);
+
+    // Timer-triggered sampling of the voltage channel (AVR): Timer1 compare B
+    // auto-triggers one conversion every 1/rate seconds and the ADC interrupt
+    // accumulates it, so begin(crossings, ...) samples exactly crossings/2 mains
+    // cycles (rate/mainsHz samples each) whatever loop() is doing. The window is
+    // coherent with the mains, so its mean is the DC offset. Oversampling and the
+    // current channel are not used in this mode. rate = 0 restores software pacing.
+    void voltageTimerSampling(unsigned int rate, unsigned int mainsHz = 50);
+    static void handleADC();                          //Called from the ADC interrupt
+
+    // Hands the conversions that do not belong to a voltage window (AVR) to
+    // another module, e.g. a background channel scanner. The handler runs in
+    // the ADC interrupt; 0 detaches it.
+    static void attachIdleADC(void (*handler)(int));
+
     void voltageTX(double _VCAL, double _PHASECAL);
     void currentTX(unsigned int _channel, double _ICAL);
 
     void calcVI(unsigned int crossings, unsigned int timeout);
     double calcIrms(unsigned int NUMBER_OF_SAMPLES);
+
+    // Resumable (time-sliced) version of calcVI: begin() arms a measurement,
+    // step() processes samples for at most budget_us microseconds and returns,
+    // ready() tells when the window is complete and result() returns Vrms.
+    // cancel() drops a window in progress.
+    void begin(unsigned int crossings, unsigned int timeout);
+    void step(unsigned long budget_us);
+    bool ready();
+    bool busy();
+    double result();
+    void cancel();
     void serialprint();
 
     long readVcc();
@@ -64,6 +98,13 @@ class EnergyMonitor
       Vrms,
       Irms;
 
+    //Waveform quality of the last voltage window, derived from the same samples
+    double frequency,                   //Line frequency from the zero-crossing timestamps [Hz], 0 if unknown
+                                        //or if a software window was split across step() calls
+      crestFactor,                      //Peak / RMS (1.414 for a pure sine)
+      distortion;                       //Harmonic distortion estimate from the form factor (0 for a pure sine)
+    bool timedOut;                      //The last window hit the timeout before completing
+
   private:
 
     //Set Voltage and current input pins
@@ -75,6 +116,14 @@ class EnergyMonitor
     double ICAL;
     double PHASECAL;
 
+    //Voltage oversampling configuration
+    unsigned int overBitsV;
+    bool noiseSleepV;
+    long adcCountsV;                                  //Full scale of the (oversampled) voltage samples.
+
+    int readV();
+    int readSleepV();
+
     //--------------------------------------------------------------------------------------
     // Variable declaration for emon_calc procedure
     //--------------------------------------------------------------------------------------
@@ -94,6 +143,45 @@ class EnergyMonitor
 
     boolean lastVCross, checkVCross;                  //Used to measure number of times threshold is crossed.
 
+    //--------------------------------------------------------------------------------------
+    // State kept between step() calls
+    //--------------------------------------------------------------------------------------
+    enum { VI_IDLE, VI_WAIT_START, VI_SAMPLING, VI_DONE } viState;
+
+    unsigned int crossCount;                          //Crossings counted so far in the current window.
+    unsigned int numberOfSamples;                     //Samples taken so far in the current window.
+    unsigned int targetCrossings;
+    unsigned int timeoutMs;
+    unsigned long startMs;
+    int SupplyVoltage;
+
+    unsigned long firstCrossUs, lastCrossUs;          //Timestamps of the first and last crossings of the window.
+    double sumAbsV, peakV;                            //Mean-absolute and peak accumulators for the waveform metrics.
+    bool splitVI;                                     //The software window was sampled across several step() calls.
+
+    void sampleVI();
+    void finishVI();
+
+    //--------------------------------------------------------------------------------------
+    // Timer-triggered sampling (see voltageTimerSampling), written from the ADC interrupt
+    //--------------------------------------------------------------------------------------
+    unsigned int sampleRate;                          //Samples per second, 0 = software paced.
+    unsigned int samplesPerCycle;
+    int midV;                                         //Mean of the previous window, reference for crossings.
+
+    volatile bool tsDone, tsAbove, tsDiscard;
+    volatile unsigned int tsRemaining, tsIndex;
+    volatile unsigned int tsCrossCount, tsFirstCross, tsLastCross;
+    volatile long tsSum;
+    volatile unsigned long tsSumSq, tsSumAbs;
+    volatile int tsMin, tsMax;
+
+    static EnergyMonitor* timerMonitor;
+    static void (*idleHandler)(int);
+
+    void startTimerVI(unsigned int samples);
+    void stopTimerVI();
+    void finishTimerVI();
 
 };
 
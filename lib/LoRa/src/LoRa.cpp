@@ -47,11 +47,14 @@
 #define MODE_TX                  0x03
 #define MODE_RX_CONTINUOUS       0x05
 #define MODE_RX_SINGLE           0x06
+#define MODE_CAD                 0x07
 
 // PA config
 #define PA_BOOST                 0x80
 
 // IRQ masks
+#define IRQ_CAD_DETECTED_MASK      0x01
+#define IRQ_CAD_DONE_MASK          0x04
 #define IRQ_TX_DONE_MASK           0x08
 #define IRQ_PAYLOAD_CRC_ERROR_MASK 0x20
 #define IRQ_RX_DONE_MASK           0x40
@@ -62,6 +65,40 @@
 
 #define MAX_PKT_LENGTH           255
 
+// Configuration and mode registers only change when written over SPI, so
+// readRegister() serves them from a write-through RAM shadow and
+// writeRegister() skips writes that would not change them. Volatile
+// registers (FIFO, IRQ flags, RSSI, SNR, FIFO pointers...) are not shadowed.
+static int8_t shadowIndex(uint8_t address)
+{
+  switch (address) {
+    case REG_OP_MODE:             return 0;
+    case REG_FRF_MSB:             return 1;
+    case REG_FRF_MID:             return 2;
+    case REG_FRF_LSB:             return 3;
+    case REG_PA_CONFIG:           return 4;
+    case REG_OCP:                 return 5;
+    case REG_LNA:                 return 6;
+    case REG_FIFO_TX_BASE_ADDR:   return 7;
+    case REG_FIFO_RX_BASE_ADDR:   return 8;
+    case REG_MODEM_CONFIG_1:      return 9;
+    case REG_MODEM_CONFIG_2:      return 10;
+    case REG_PREAMBLE_MSB:        return 11;
+    case REG_PREAMBLE_LSB:        return 12;
+    case REG_PAYLOAD_LENGTH:      return 13;
+    case REG_MODEM_CONFIG_3:      return 14;
+    case REG_DETECTION_OPTIMIZE:  return 15;
+    case REG_INVERTIQ:            return 16;
+    case REG_DETECTION_THRESHOLD: return 17;
+    case REG_SYNC_WORD:           return 18;
+    case REG_INVERTIQ2:           return 19;
+    case REG_DIO_MAPPING_1:       return 20;
+    case REG_PA_DAC:              return 21;
+  }
+
+  return -1;
+}
+
 #if (ESP8266 || ESP32)
     #define ISR_PREFIX ICACHE_RAM_ATTR
 #else
@@ -74,9 +111,16 @@ LoRaClass::LoRaClass() :
   _ss(LORA_DEFAULT_SS_PIN), _reset(LORA_DEFAULT_RESET_PIN), _dio0(LORA_DEFAULT_DIO0_PIN),
   _frequency(0),
   _packetIndex(0),
+  _packetLength(0),
+  _payloadLength(0),
   _implicitHeaderMode(0),
   _onReceive(NULL),
-  _onTxDone(NULL)
+  _onTxDone(NULL),
+  _onCadDone(NULL),
+  _dio0Pending(false),
+  _dio0Time(0),
+  _shadowValid(0),
+  _spiTransactions(0)
 {
   // overide Stream timeout value
   setTimeout(0);
@@ -119,6 +163,9 @@ int LoRaClass::begin(long frequency)
   // start SPI
   _spi->begin();
 
+  // the registers are back to their reset values (or unknown, without a reset pin)
+  _shadowValid = 0;
+
   // check version
   uint8_t version = readRegister(REG_VERSION);
   if (version != 0x12) {
@@ -177,6 +224,7 @@ int LoRaClass::beginPacket(int implicitHeader)
   // reset FIFO address and paload length
   writeRegister(REG_FIFO_ADDR_PTR, 0);
   writeRegister(REG_PAYLOAD_LENGTH, 0);
+  _payloadLength = 0;
 
   return 1;
 }
@@ -242,6 +290,7 @@ int LoRaClass::parsePacket(int size)
     } else {
       packetLength = readRegister(REG_RX_NB_BYTES);
     }
+    _packetLength = packetLength;
 
     // set FIFO address to current RX address
     writeRegister(REG_FIFO_ADDR_PTR, readRegister(REG_FIFO_RX_CURRENT_ADDR));
@@ -295,6 +344,37 @@ int LoRaClass::rssi()
   return (readRegister(REG_RSSI_VALUE) - (_frequency < RF_MID_BAND_THRESHOLD ? RSSI_OFFSET_LF_PORT : RSSI_OFFSET_HF_PORT));
 }
 
+unsigned long LoRaClass::timeOnAir(int length)
+{
+  // Semtech SX1276/77/78/79 datasheet, section 4.1.1.7 (the modem config comes from the register shadow)
+  uint8_t config1 = readRegister(REG_MODEM_CONFIG_1);
+  uint8_t config2 = readRegister(REG_MODEM_CONFIG_2);
+  uint8_t config3 = readRegister(REG_MODEM_CONFIG_3);
+
+  long sf = config2 >> 4;
+  long cr = (config1 >> 1) & 0x07;
+  long crc = (config2 >> 2) & 0x01;
+  long ih = config1 & 0x01;
+  long de = (config3 >> 3) & 0x01;
+  long preamble = ((long)readRegister(REG_PREAMBLE_MSB) << 8) | readRegister(REG_PREAMBLE_LSB);
+
+  unsigned long symbolTime = (1UL << sf) * 1000000UL / getSignalBandwidth(); // us
+
+  // payload symbols: 8 + max(ceil((8PL - 4SF + 28 + 16CRC - 20IH) / (4(SF - 2DE))) * (CR + 4), 0)
+  long numerator = 8L * length - 4 * sf + 28 + 16 * crc - 20 * ih;
+  long denominator = 4 * (sf - 2 * de);
+  long payloadSymbols = 8;
+  if (numerator > 0) {
+    payloadSymbols += ((numerator + denominator - 1) / denominator) * (cr + 4);
+  }
+
+  // preamble lasts (preamble + 4.25) symbols, counted here in quarter symbols
+  unsigned long time = ((4 * preamble + 17) * symbolTime) / 4 + payloadSymbols * symbolTime;
+
+  // round up to ms
+  return (time + 999) / 1000;
+}
+
 size_t LoRaClass::write(uint8_t byte)
 {
   return write(&byte, sizeof(byte));
@@ -302,27 +382,24 @@ size_t LoRaClass::write(uint8_t byte)
 
 size_t LoRaClass::write(const uint8_t *buffer, size_t size)
 {
-  int currentLength = readRegister(REG_PAYLOAD_LENGTH);
-
   // check size
-  if ((currentLength + size) > MAX_PKT_LENGTH) {
-    size = MAX_PKT_LENGTH - currentLength;
+  if ((_payloadLength + size) > MAX_PKT_LENGTH) {
+    size = MAX_PKT_LENGTH - _payloadLength;
   }
 
-  // write data
-  for (size_t i = 0; i < size; i++) {
-    writeRegister(REG_FIFO, buffer[i]);
-  }
+  // write data (the FIFO pointer auto-increments during the burst)
+  burstTransfer(REG_FIFO | 0x80, buffer, NULL, size);
 
   // update length
-  writeRegister(REG_PAYLOAD_LENGTH, currentLength + size);
+  _payloadLength += size;
+  writeRegister(REG_PAYLOAD_LENGTH, _payloadLength);
 
   return size;
 }
 
 int LoRaClass::available()
 {
-  return (readRegister(REG_RX_NB_BYTES) - _packetIndex);
+  return (_packetLength - _packetIndex);
 }
 
 int LoRaClass::read()
@@ -358,22 +435,34 @@ void LoRaClass::flush()
 {
 }
 
+size_t LoRaClass::readBytes(uint8_t *buffer, size_t length)
+{
+  int remaining = available();
+  if (remaining <= 0) {
+    return 0;
+  }
+  if (length > (size_t)remaining) {
+    length = remaining;
+  }
+
+  // read data (the FIFO pointer auto-increments during the burst)
+  burstTransfer(REG_FIFO & 0x7f, NULL, buffer, length);
+  _packetIndex += length;
+
+  return length;
+}
+
 #ifndef ARDUINO_SAMD_MKRWAN1300
 void LoRaClass::onReceive(void(*callback)(int))
 {
   _onReceive = callback;
 
   if (callback) {
+    // the ISR only latches the event (no SPI), so SPI.usingInterrupt() is not needed
     pinMode(_dio0, INPUT);
-#ifdef SPI_HAS_NOTUSINGINTERRUPT
-    SPI.usingInterrupt(digitalPinToInterrupt(_dio0));
-#endif
     attachInterrupt(digitalPinToInterrupt(_dio0), LoRaClass::onDio0Rise, RISING);
   } else {
     detachInterrupt(digitalPinToInterrupt(_dio0));
-#ifdef SPI_HAS_NOTUSINGINTERRUPT
-    SPI.notUsingInterrupt(digitalPinToInterrupt(_dio0));
-#endif
   }
 }
 
@@ -381,20 +470,63 @@ void LoRaClass::onTxDone(void(*callback)())
 {
   _onTxDone = callback;
 
+  if (callback) {
+    // the ISR only latches the event (no SPI), so SPI.usingInterrupt() is not needed
+    pinMode(_dio0, INPUT);
+    attachInterrupt(digitalPinToInterrupt(_dio0), LoRaClass::onDio0Rise, RISING);
+  } else {
+    detachInterrupt(digitalPinToInterrupt(_dio0));
+  }
+}
+
+void LoRaClass::onCadDone(void(*callback)(boolean))
+{
+  _onCadDone = callback;
+
   if (callback) {
     pinMode(_dio0, INPUT);
-#ifdef SPI_HAS_NOTUSINGINTERRUPT
-    SPI.usingInterrupt(digitalPinToInterrupt(_dio0));
-#endif
     attachInterrupt(digitalPinToInterrupt(_dio0), LoRaClass::onDio0Rise, RISING);
   } else {
     detachInterrupt(digitalPinToInterrupt(_dio0));
-#ifdef SPI_HAS_NOTUSINGINTERRUPT
-    SPI.notUsingInterrupt(digitalPinToInterrupt(_dio0));
-#endif
   }
 }
 
+void LoRaClass::channelActivityDetection()
+{
+  // CAD is started from standby
+  idle();
+
+  // CadDetected is read from the IRQ flags when CadDone fires, see handleDio0Rise()
+  writeRegister(REG_DIO_MAPPING_1, 0xa0); // DIO0 => CADDONE
+  writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_CAD);
+}
+
+bool LoRaClass::handleInterrupt()
+{
+  if (!_dio0Pending) {
+    return false;
+  }
+
+  // the flag is only set by the ISR, clearing it here is race-free:
+  // an edge latched after this point is simply handled on the next call
+  _dio0Pending = false;
+
+  handleDio0Rise();
+
+  return true;
+}
+
+unsigned long LoRaClass::interruptTime()
+{
+  unsigned long time;
+
+  noInterrupts();
+  time = _dio0Time;
+  interrupts();
+
+  return time;
+}
+
 void LoRaClass::receive(int size)
 {
 
@@ -671,7 +803,7 @@ void LoRaClass::dumpRegisters(Stream& out)
     out.print("0x");
     out.print(i, HEX);
     out.print(": 0x");
-    out.println(readRegister(i), HEX);
+    out.println(singleTransfer(i & 0x7f, 0x00), HEX);
   }
 }
 
@@ -696,7 +828,15 @@ void LoRaClass::handleDio0Rise()
   // clear IRQ's
   writeRegister(REG_IRQ_FLAGS, irqFlags);
 
-  if ((irqFlags & IRQ_PAYLOAD_CRC_ERROR_MASK) == 0) {
+  // RX_DONE, CAD_DONE and TX_DONE are checked independently: an RX_DONE latched
+  // before channelActivityDetection() shows up together with CAD_DONE (CAD leaves
+  // the FIFO alone, so the packet is still reported, before the CAD callback can
+  // start a transmission); one latched before beginPacket() shows up together
+  // with TX_DONE, and by then the shared FIFO holds the transmitted payload, so
+  // that packet is dropped instead of reported
+  bool stale = (irqFlags & IRQ_TX_DONE_MASK) != 0;
+
+  if ((irqFlags & IRQ_PAYLOAD_CRC_ERROR_MASK) == 0 && !stale) {
 
     if ((irqFlags & IRQ_RX_DONE_MASK) != 0) {
       // received a packet
@@ -704,6 +844,7 @@ void LoRaClass::handleDio0Rise()
 
       // read packet length
       int packetLength = _implicitHeaderMode ? readRegister(REG_PAYLOAD_LENGTH) : readRegister(REG_RX_NB_BYTES);
+      _packetLength = packetLength;
 
       // set FIFO address to current RX address
       writeRegister(REG_FIFO_ADDR_PTR, readRegister(REG_FIFO_RX_CURRENT_ADDR));
@@ -712,28 +853,81 @@ void LoRaClass::handleDio0Rise()
         _onReceive(packetLength);
       }
     }
-    else if ((irqFlags & IRQ_TX_DONE_MASK) != 0) {
-      if (_onTxDone) {
-        _onTxDone();
-      }
+  }
+
+  if ((irqFlags & IRQ_CAD_DONE_MASK) != 0) {
+    if (_onCadDone) {
+      _onCadDone((irqFlags & IRQ_CAD_DETECTED_MASK) != 0);
+    }
+  }
+
+  if ((irqFlags & IRQ_TX_DONE_MASK) != 0) {
+    if (_onTxDone) {
+      _onTxDone();
     }
   }
 }
 
 uint8_t LoRaClass::readRegister(uint8_t address)
 {
-  return singleTransfer(address & 0x7f, 0x00);
+  int8_t index = shadowIndex(address);
+
+  if (index >= 0 && bitRead(_shadowValid, index)) {
+    return _shadow[index];
+  }
+
+  uint8_t value = singleTransfer(address & 0x7f, 0x00);
+
+  if (index >= 0) {
+    shadowRegister(index, address, value);
+  }
+
+  return value;
 }
 
 void LoRaClass::writeRegister(uint8_t address, uint8_t value)
 {
+  int8_t index = shadowIndex(address);
+
+  if (index >= 0 && bitRead(_shadowValid, index) && _shadow[index] == value) {
+    // already set
+    return;
+  }
+
   singleTransfer(address | 0x80, value);
+
+  if (index >= 0) {
+    shadowRegister(index, address, value);
+  }
+}
+
+void LoRaClass::shadowRegister(int8_t index, uint8_t address, uint8_t value)
+{
+  if (address == REG_OP_MODE) {
+    uint8_t mode = value & 0x07;
+
+    // the radio leaves TX, single RX and CAD on its own: always read those back
+    if (mode == MODE_TX || mode == MODE_RX_SINGLE || mode == MODE_CAD) {
+      bitClear(_shadowValid, index);
+      return;
+    }
+  }
+
+  _shadow[index] = value;
+  bitSet(_shadowValid, index);
+}
+
+unsigned long LoRaClass::spiTransactions()
+{
+  return _spiTransactions;
 }
 
 uint8_t LoRaClass::singleTransfer(uint8_t address, uint8_t value)
 {
   uint8_t response;
 
+  _spiTransactions++;
+
   digitalWrite(_ss, LOW);
 
   _spi->beginTransaction(_spiSettings);
@@ -746,9 +940,32 @@ uint8_t LoRaClass::singleTransfer(uint8_t address, uint8_t value)
   return response;
 }
 
+void LoRaClass::burstTransfer(uint8_t address, const uint8_t* out, uint8_t* in, size_t size)
+{
+  uint8_t response;
+
+  _spiTransactions++;
+
+  digitalWrite(_ss, LOW);
+
+  _spi->beginTransaction(_spiSettings);
+  _spi->transfer(address);
+  for (size_t i = 0; i < size; i++) {
+    response = _spi->transfer(out ? out[i] : 0x00);
+    if (in) {
+      in[i] = response;
+    }
+  }
+  _spi->endTransaction();
+
+  digitalWrite(_ss, HIGH);
+}
+
 ISR_PREFIX void LoRaClass::onDio0Rise()
 {
-  LoRa.handleDio0Rise();
+  // bottom half: only latch the event, handleInterrupt() does the SPI work
+  LoRa._dio0Time = millis();
+  LoRa._dio0Pending = true;
 }
 
 LoRaClass LoRa;
@@ -30,6 +30,9 @@
 #define PA_OUTPUT_RFO_PIN          0
 #define PA_OUTPUT_PA_BOOST_PIN     1
 
+// configuration registers mirrored in RAM (see shadowIndex() in LoRa.cpp)
+#define LORA_SHADOW_REGISTERS      22
+
 class LoRaClass : public Stream {
 public:
   LoRaClass();
@@ -47,6 +50,8 @@ public:
 
   int rssi();
 
+  unsigned long timeOnAir(int length);
+
   // from Print
   virtual size_t write(uint8_t byte);
   virtual size_t write(const uint8_t *buffer, size_t size);
@@ -57,11 +62,20 @@ public:
   virtual int peek();
   virtual void flush();
 
+  // burst read of the received packet (single SPI transaction)
+  size_t readBytes(uint8_t *buffer, size_t length);
+  size_t readBytes(char *buffer, size_t length) { return readBytes((uint8_t *)buffer, length); }
+
 #ifndef ARDUINO_SAMD_MKRWAN1300
   void onReceive(void(*callback)(int));
   void onTxDone(void(*callback)());
+  void onCadDone(void(*callback)(boolean));
 
   void receive(int size = 0);
+  void channelActivityDetection();
+
+  bool handleInterrupt();
+  unsigned long interruptTime();
 #endif
   void idle();
   void sleep();
@@ -93,6 +107,7 @@ public:
   void setSPIFrequency(uint32_t frequency);
 
   void dumpRegisters(Stream& out);
+  unsigned long spiTransactions();
 
 private:
   void explicitHeaderMode();
@@ -109,6 +124,8 @@ private:
   uint8_t readRegister(uint8_t address);
   void writeRegister(uint8_t address, uint8_t value);
   uint8_t singleTransfer(uint8_t address, uint8_t value);
+  void shadowRegister(int8_t index, uint8_t address, uint8_t value);
+  void burstTransfer(uint8_t address, const uint8_t* out, uint8_t* in, size_t size);
 
   static void onDio0Rise();
 
@@ -120,9 +137,17 @@ private:
   int _dio0;
   long _frequency;
   int _packetIndex;
+  int _packetLength;
+  int _payloadLength;
   int _implicitHeaderMode;
   void (*_onReceive)(int);
   void (*_onTxDone)();
+  void (*_onCadDone)(boolean);
+  volatile bool _dio0Pending;
+  volatile unsigned long _dio0Time;
+  uint8_t _shadow[LORA_SHADOW_REGISTERS];
+  uint32_t _shadowValid;
+  unsigned long _spiTransactions;
 };
 
 extern LoRaClass LoRa;
@@ -142,6 +142,7 @@ sample code bearing this copyright.
 #include <Arduino.h>
 #include "OneWire.h"
 #include "util/OneWire_direct_gpio.h"
+#include "util/OneWire_slot_timing.h"
 
 
 void OneWire::begin(uint8_t pin)
@@ -155,6 +156,127 @@ void OneWire::begin(uint8_t pin)
 }
 
 
+#if ONEWIRE_TIMER_SLOTS && defined(TIMER2_COMPB_vect)
+
+// What the compare match interrupt does to the bus when it fires.
+#define OW_ACTION_IDLE       0
+#define OW_ACTION_DRIVE_HIGH 1	// end of a write slot
+#define OW_ACTION_FLOAT      2	// end of the reset pulse, then sample presence
+#define OW_ACTION_SAMPLE     3
+
+static volatile IO_REG_TYPE *owTimerReg;
+static IO_REG_TYPE owTimerMask;
+static volatile uint8_t owTimerAction = OW_ACTION_IDLE;
+static volatile uint8_t owTimerResult;
+static uint8_t owTimerReleased;
+
+// Schedule 'action' 'ticks' from now.  Call with interrupts disabled.
+static void owTimerArm(volatile IO_REG_TYPE *reg, IO_REG_TYPE mask, uint8_t ticks, uint8_t action)
+{
+	owTimerReg = reg;
+	owTimerMask = mask;
+	owTimerAction = action;
+	TCCR2A = 0;
+	TCCR2B = _BV(CS21) | _BV(CS20);	// clk/32, normal mode
+	GTCCR = _BV(PSRASY);		// restart the prescaler
+	TCNT2 = 0;
+	OCR2B = ticks;
+	TIFR2 = _BV(OCF2B);
+	TIMSK2 |= _BV(OCIE2B);
+}
+
+ISR(TIMER2_COMPB_vect)
+{
+	switch (owTimerAction) {
+	case OW_ACTION_DRIVE_HIGH:
+		DIRECT_WRITE_HIGH(owTimerReg, owTimerMask);
+		break;
+	case OW_ACTION_FLOAT:
+		DIRECT_MODE_INPUT(owTimerReg, owTimerMask);
+		owTimerReleased = TCNT2;
+		owTimerAction = OW_ACTION_SAMPLE;
+		OCR2B = owTimerReleased + OW_PRESENCE_ARM_TICKS;
+		return;
+	case OW_ACTION_SAMPLE:
+		// armed ONEWIRE_PRESENCE_LATENCY_US early, see OneWire_slot_timing.h
+		while ((uint8_t)(TCNT2 - owTimerReleased) < OW_PRESENCE_SAMPLE_TICKS) ;
+		owTimerResult = !DIRECT_READ(owTimerReg, owTimerMask);
+		break;
+	}
+	TIMSK2 &= ~_BV(OCIE2B);
+	owTimerAction = OW_ACTION_IDLE;
+}
+
+// Perform the onewire reset function.  We will wait up to 250uS for
+// the bus to come high, if it doesn't then it is broken or shorted
+// and we return a 0;
+//
+// The 480 uS reset pulse and the presence sample 60-75 uS after it are
+// timed by Timer2.  The caller still waits for them (calling yield()),
+// but with interrupts enabled; only the compare interrupt that takes
+// the sample spins, with interrupts disabled, until 60 uS have passed.
+//
+// Returns 1 if a device asserted a presence pulse, 0 otherwise.
+//
+uint8_t OneWire::reset(void)
+{
+	IO_REG_TYPE mask IO_REG_MASK_ATTR = bitmask;
+	volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
+	uint8_t retries = 125;
+
+	noInterrupts();
+	DIRECT_MODE_INPUT(reg, mask);
+	interrupts();
+	// wait until the wire is high... just in case
+	do {
+		if (--retries == 0) return 0;
+		delayMicroseconds(2);
+	} while ( !DIRECT_READ(reg, mask));
+
+	noInterrupts();
+	DIRECT_WRITE_LOW(reg, mask);
+	DIRECT_MODE_OUTPUT(reg, mask);	// drive output low
+	owTimerArm(reg, mask, OW_US_TO_TICKS(OW_RESET_LOW_US), OW_ACTION_FLOAT);
+	interrupts();
+	while (owTimerAction != OW_ACTION_IDLE) yield();
+	delayMicroseconds(OW_RESET_LOW_US - OW_PRESENCE_MIN_US);
+	return owTimerResult;
+}
+
+//
+// Write a bit. Port and bit is used to cut lookup time and provide
+// more certain timing.
+//
+// A 1 only needs the short low pulse done with interrupts disabled;
+// the low phase of a 0 is ended by Timer2 while the caller waits
+// (calling yield()) with interrupts enabled.
+//
+void OneWire::write_bit(uint8_t v)
+{
+	IO_REG_TYPE mask IO_REG_MASK_ATTR = bitmask;
+	volatile IO_REG_TYPE *reg IO_REG_BASE_ATTR = baseReg;
+
+	if (v & 1) {
+		noInterrupts();
+		DIRECT_WRITE_LOW(reg, mask);
+		DIRECT_MODE_OUTPUT(reg, mask);	// drive output low
+		delayMicroseconds(6);
+		DIRECT_WRITE_HIGH(reg, mask);	// drive output high
+		interrupts();
+		delayMicroseconds(59);
+	} else {
+		noInterrupts();
+		DIRECT_WRITE_LOW(reg, mask);
+		DIRECT_MODE_OUTPUT(reg, mask);	// drive output low
+		owTimerArm(reg, mask, OW_US_TO_TICKS(OW_WRITE0_LOW_US), OW_ACTION_DRIVE_HIGH);
+		interrupts();
+		while (owTimerAction != OW_ACTION_IDLE) yield();
+		delayMicroseconds(5);
+	}
+}
+
+#else
+
 // Perform the onewire reset function.  We will wait up to 250uS for
 // the bus to come high, if it doesn't then it is broken or shorted
 // and we return a 0;
@@ -219,6 +341,8 @@ void OneWire::write_bit(uint8_t v)
 	}
 }
 
+#endif
+
 //
 // Read a bit. Port and bit is used to cut lookup time and provide
 // more certain timing.
@@ -51,6 +51,22 @@
 #define ONEWIRE_CRC16 1
 #endif
 
+// Drive the long parts of the reset and write-0 slots from a Timer2
+// compare match interrupt (AVR only) instead of busy-waiting with
+// interrupts disabled.  The caller still waits for each slot to end,
+// calling yield(), but with interrupts enabled; they are only held off
+// for the part of each slot that is really timing critical (the read
+// sample, and the compare interrupt that spins before the presence
+// sample: ~34 uS from entry to reti, see util/OneWire_slot_timing.h), so other
+// interrupts (radio, serial) are not delayed by a whole slot.  The presence sample tolerates ONEWIRE_PRESENCE_LATENCY_US of
+// interrupt latency; raise it if longer handlers are added.  Timer2
+// is claimed by the library while a slot is in progress, so tone() and
+// PWM on pins 3 and 11 can't be used with this option.  Only one bus
+// at a time may be driven.
+#ifndef ONEWIRE_TIMER_SLOTS
+#define ONEWIRE_TIMER_SLOTS 0
+#endif
+
 // Board-specific macros for direct GPIO
 #include "util/OneWire_direct_regtype.h"
 
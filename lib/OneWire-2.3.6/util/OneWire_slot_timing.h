@@ -0,0 +1,34 @@
+#ifndef OneWire_Slot_Timing_h
+#define OneWire_Slot_Timing_h
+
+// Slot timing of the Timer2 backend (see ONEWIRE_TIMER_SLOTS).  Only
+// macros, so the timing can also be checked on a host build.
+
+// Timer2 runs at clk/32: 2 uS per tick at 16 MHz, so up to 510 uS fit
+// in a single compare.
+#define OW_TIMER_PRESCALER 32
+#define OW_US_TO_TICKS(us) ((uint8_t)(((us) * (F_CPU / 1000000UL) + OW_TIMER_PRESCALER - 1) / OW_TIMER_PRESCALER))
+#define OW_TICKS_TO_US(ticks) ((ticks) * OW_TIMER_PRESCALER / (F_CPU / 1000000UL))
+
+// Low phases ended by the compare match interrupt.
+#define OW_RESET_LOW_US   480
+#define OW_WRITE0_LOW_US  65
+
+// A slave's presence pulse is only guaranteed to be on the bus from 60
+// to 75 uS after the reset pulse (tPDHIGH max, tPDHIGH + tPDLOW min).
+#define OW_PRESENCE_MIN_US 60
+#define OW_PRESENCE_MAX_US 75
+
+// Worst-case latency of the presence sample interrupt, in uS: the
+// handler that may already be running plus every higher-priority one
+// that may be pending.  The compare is armed early enough that the
+// handler still starts by OW_PRESENCE_MAX_US this late; when it starts
+// early it spins until OW_PRESENCE_MIN_US, with interrupts disabled.
+#ifndef ONEWIRE_PRESENCE_LATENCY_US
+#define ONEWIRE_PRESENCE_LATENCY_US 45
+#endif
+
+#define OW_PRESENCE_ARM_TICKS ((uint8_t)((OW_PRESENCE_MAX_US - ONEWIRE_PRESENCE_LATENCY_US) * (F_CPU / 1000000UL) / OW_TIMER_PRESCALER))
+#define OW_PRESENCE_SAMPLE_TICKS (OW_US_TO_TICKS(OW_PRESENCE_MIN_US) + 1)
+
+#endif
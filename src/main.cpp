@@ -26,26 +26,79 @@
 // Biblioteca necesaria para reservar espacios de memoria fijos para las Strings utilizadas.
 #include <StringReserveCheck.h> // https://www.forward.com.au/pfod/ArduinoProgramming/ArduinoStrings/index.html
 
+// Biblioteca necesaria para persistir la dirección ROM del DS18B20.
+#include <EEPROM.h>             // https://www.arduino.cc/en/Reference/EEPROM
+
 // Biblioteca necesaria para utilizar el watchdog timer. 
 #include <avr/wdt.h>            // https://www.nongnu.org/avr-libc/user-manual/group__avr__watchdog.html
 
 /// Declaración de variables globales.
 
 /**
-    voltages es un array de floats que contiene los valores de tensión medidos entre cada
-    transmisión LoRa. El tamaño del array depende del intervalo de tiempo entre cada transmisión
-    LoRa (TIMEOUT_LORA) y el intervalo de tiempo entre cada medición (TIMEOUT_READ_SENSORS).
-    Una vez realizada la transmisión, todos los valores de este array vuelven a ponerse en 0.
+    temperatureProbes contiene las direcciones ROM de 64 bits de los DS18B20 del bus, en el orden
+    en que los devuelve la búsqueda OneWire. Se descubren una única vez (o se leen desde la EEPROM)
+    para direccionar cada sonda directamente, evitando una búsqueda en el bus en cada medición.
+*/
+DeviceAddress temperatureProbes[TEMPERATURA_PROBES];
+
+/**
+    temperatureProbesFound es la cantidad de direcciones válidas en temperatureProbes.
+    Vuelve a ponerse en 0 ante un error de CRC o una desconexión, forzando un nuevo
+    descubrimiento de las sondas.
+*/
+uint8_t temperatureProbesFound = 0;
+
+/**
+    temperatureResolution es la resolución (9 a 12 bits) con la que se configuró a los DS18B20
+    para la próxima conversión. Se ajusta dinámicamente en base a la velocidad de cambio de la
+    temperatura y a la cercanía a los umbrales de alerta. Vale 0 mientras se desconozca la
+    resolución de las sondas (en ese caso se espera el peor tiempo de conversión).
+*/
+uint8_t temperatureResolution = 0;
+
+/**
+    temperatureConverting es un flag que se pone en true mientras los DS18B20 realizan una
+    conversión pedida de forma no bloqueante.
+*/
+bool temperatureConverting = false;
+
+/**
+    temperatureConversionStart contiene el valor de millis() al momento de pedir la conversión.
+*/
+unsigned long temperatureConversionStart = 0;
+
+/**
+    previousTemperatures contiene la última temperatura válida de cada sonda (en cuentas crudas,
+    1/128 °C), utilizada para estimar la velocidad de cambio de la temperatura.
+*/
+int16_t previousTemperatures[TEMPERATURA_PROBES] = {0};
+
+/**
+    expansionSums y expansionCounts contienen, para cada canal del puerto de expansión (A3 a A7),
+    la suma y la cantidad de conversiones acumuladas por la interrupción del ADC desde el último
+    promedio. Se vuelven a 0 cada vez que se leen.
+*/
+volatile uint32_t expansionSums[EXPANSION_CHANNELS] = {0};
+volatile uint16_t expansionCounts[EXPANSION_CHANNELS] = {0};
+
+/**
+    expansionChannel es el canal del puerto de expansión (0 = A3) que se está convirtiendo.
+*/
+volatile uint8_t expansionChannel = 0;
+
+/**
+    expansionScanning es un flag que se pone en true mientras el barrido del puerto de expansión
+    está activo, y expansionDiscard uno que pide descartar la primera conversión luego de reanudarlo.
 */
-float voltages[ARRAY_SIZE] = {0.0};
+volatile bool expansionScanning = false;
+volatile bool expansionDiscard = false;
 
 /**
-    temperatures es un array de floats que contiene los valores de temperatura medidos entre cada
-    transmisión LoRa. El tamaño del array depende del intervalo de tiempo entre cada transmisión
-    LoRa y el intervalo de tiempo entre cada medición.
-    Una vez realizada la transmisión, todos los valores de este array vuelven a ponerse en 0.
+    sensorHealth es una máscara de bits HEALTH_* (ver constants.h) con las fallas de los sensores
+    ocurridas desde la última transmisión. Los drivers la completan y se reporta en cada payload,
+    junto con los sensores que se quedaron sin muestras. Una vez realizada la transmisión, vuelve a 0.
 */
-float temperatures[ARRAY_SIZE] = {0.0};
+uint8_t sensorHealth = 0;
 
 /**
     currentBuffer es un float que contiene el último valor de corriente reportado por el
@@ -59,12 +112,6 @@ float currentBuffer = 0.0;
 */
 float gasBuffer = 0.0;
 
-/**
-    index es una variable de tipo int utilizado para recorrer los arrays de medición.
-    Una vez realizada la transmisión, vuelve a ponerse en 0.
-*/
-int index = 0;
-
 /**
     dayTime es un flag que se pone en true o en false remotamente.
     Si dayTime es false, significa que hay luz ambiental exterior, por lo que no
@@ -85,12 +132,31 @@ bool doorOpen = false;
 bool emergency = false;
 
 /**
-    refreshRequested contiene SENSORS_QTY variables booleanas que representan la necesidad
-    de refrescar los valores de los arrays de medición. Estos tienen un orden arbitrario:
-    { Tensión, Temperatura }
-    Una vez refrescado, cada uno de estos booleanos vuelve a ponerse en false.
+    doorEdgePending y emergencyEdgePending son flags que se ponen en true desde la interrupción por
+    cambio de pin (PCINT) cuando el sensor de puerta o el botón antipánico cambian de nivel.
+    Arrancan en true para que los observers lean el nivel inicial de cada entrada.
 */
-bool refreshRequested[SENSORS_QTY] = {false};
+volatile bool doorEdgePending = true;
+volatile bool emergencyEdgePending = true;
+
+/**
+    doorEdgeMillis y emergencyEdgeMillis contienen el valor de millis() del último flanco detectado
+    en cada entrada. El nivel se toma como válido una vez que pasaron INPUTS_DEBOUNCE_MS sin flancos.
+*/
+volatile unsigned long doorEdgeMillis = 0;
+volatile unsigned long emergencyEdgeMillis = 0;
+
+/**
+    emergencyLatched es un flag que se pone en true desde la interrupción en cuanto se presiona el
+    botón antipánico, por breve que sea la pulsación, y que sólo se baja luego de reportarla por LoRa.
+*/
+volatile bool emergencyLatched = false;
+
+/**
+    doorOpenedLatched es un flag que se pone en true desde la interrupción en cuanto se abre la
+    puerta, por breve que sea la apertura, y que sólo se baja luego de reportarla por LoRa.
+*/
+volatile bool doorOpenedLatched = false;
 
 /**
     outcomingFull es una string que contiene el mensaje LoRa de salida preformateado especialmente
@@ -99,92 +165,153 @@ bool refreshRequested[SENSORS_QTY] = {false};
 String outcomingFull;
 
 /**
-    incomingFull es una string que contiene el mensaje LoRa de entrada, incluyendo
-    el identificador de nodo.
+    outcomingFrame es un buffer que contiene la trama binaria LoRa de salida (ver composeLoRaFrame()),
+    utilizada en lugar de outcomingFull cuando LORA_BINARY_FRAME es TRUE. outcomingFrameSize es
+    su longitud en bytes.
 */
-String incomingFull;
+uint8_t outcomingFrame[LORA_FRAME_MAX_SIZE];
+uint8_t outcomingFrameSize = 0;
 
 /**
-    incomingFullComplete es un flag que se pone en true luego de completarse la función de interrupción
-    onRecieve de LoRa, provisto que la carga útil sea una string con entre 0 y INCOMING_FULL_MAX_SIZE 
-    bytes.  
+    loraTxState es el estado de la transmisión LoRa asincrónica:
+        - LORA_TX_IDLE: el módulo está en modo recepción y se puede transmitir,
+        - LORA_TX_CAD: el módulo busca actividad en el canal antes de transmitir,
+        - LORA_TX_BACKOFF: el canal estaba ocupado; se espera loraTxBackoff ms en modo recepción,
+        - LORA_TX_SENDING: hay un paquete en el aire,
+        - LORA_TX_DONE: onTxDone() recibió TX_DONE; falta volver a modo recepción.
 */
-bool incomingFullComplete = false;
+enum LoRaTxState { LORA_TX_IDLE, LORA_TX_CAD, LORA_TX_BACKOFF, LORA_TX_SENDING, LORA_TX_DONE };
+LoRaTxState loraTxState = LORA_TX_IDLE;
 
 /**
-    receiverStr es una string que sólo contiene el identificador de nodo
-    recibido en un mensaje LoRa entrante.
+    loraTxStart contiene el valor de millis() al momento de entrar en el estado actual de loraTxState.
 */
-String receiverStr;
+unsigned long loraTxStart = 0;
 
 /**
-    incomingPayload es una string que contiene sólo la carga útil del mensaje LoRa de entrada,
-    utilizada sólo cuando el identificador de nodo coincide con DEVICE_ID o con BROADCAST_ID.
+    loraTxFrame indica si el paquete pendiente es outcomingFrame (true) u outcomingFull (false), y
+    loraTxAirtime, su tiempo en el aire (en ms), que se descuenta al transmitirlo.
 */
-String incomingPayload;
+bool loraTxFrame = false;
+unsigned long loraTxAirtime = 0;
 
 /**
-    knownCommands es un array de Strings que contiene los comandos LoRa que
-    se pueden ejecutar.
+    loraLbtAttempts cuenta las veces seguidas que el paquete pendiente encontró el canal ocupado,
+    y loraTxBackoff es la espera aleatoria actual (en ms) antes de volver a escucharlo.
 */
-const String knownCommands[KNOWN_COMMANDS_SIZE] = {
-    "startAlert",   // inicia una alerta con el siguiente llamado a función: startAlert(750, 10);
-    "daytime",      // alerta a la cabina que es de día.
-    "nighttime"    // alerta a la cabina que es de noche.
-};
+uint8_t loraLbtAttempts = 0;
+unsigned long loraTxBackoff = 0;
 
 /**
-    statusOutgoing es una string que puede tomar uno de los siguientes valores:
-    - 'S': cabina en servicio.
-    - 'L': cabina en modo limitado.
-    - 'F': cabina fuera de servicio.
+    dutyCycleAirtime contiene el tiempo en el aire (en ms) transmitido en cada intervalo de la
+    ventana móvil del ciclo de trabajo; dutyCycleBucket es el intervalo actual y
+    dutyCycleBucketStart, el valor de millis() en que comenzó (ver duty_cycle.h).
 */
-String statusOutcoming = "F";
+unsigned long dutyCycleAirtime[LORA_DUTY_BUCKETS] = {0};
+uint8_t dutyCycleBucket = 0;
+unsigned long dutyCycleBucketStart = 0;
 
 /**
-    currentStr es una string que contiene el valor de corriente actual, antes de parsearlo a float.
+    loraDataRate es el índice del data rate actual en loraDataRates y loraTxPower, la potencia de
+    transmisión actual (en dBm). adrChanged indica que falta aplicarlos al módulo (ver adrApply()).
 */
-String currentStr = "";
+uint8_t loraDataRate = LORA_ADR_DR;
+int8_t loraTxPower = LORA_TX_POWER_MAX;
+bool adrChanged = true;
 
 /**
-    gasStr es una string que contiene el valor de nivel de combustible actual, antes de parsearlo a float.
+    adrPinned indica que el data rate y la potencia fueron fijados por un comando de downlink.
+    adrSamples es la cantidad de downlinks observados desde la última adaptación, adrBestMargin
+    el mejor margen de enlace entre ellos (en dB) y adrSilentReports la cantidad de reportes
+    transmitidos desde el último downlink del concentrador.
 */
-String gasStr = "";
+bool adrPinned = false;
+uint8_t adrSamples = 0;
+int adrBestMargin = 0;
+uint8_t adrSilentReports = 0;
 
 /**
-    equalSign es el caracter "=" almacenado en una constante.
+    tdmaSynced indica que las tramas TDMA están alineadas con el beacon del concentrador.
+    tdmaFrameStart es el valor de millis() en que comenzó la trama actual, tdmaRemainder la
+    fracción de ms (en us) que arrastra, y tdmaDrift la corrección estimada de la duración de
+    cada trama por la deriva del oscilador (en us). tdmaFrame numera las tramas, tdmaUplinkFrame
+    es la última trama en que se reportó y tdmaFramesSinceBeacon, las tramas desde el último beacon.
 */
-const String equalSign = "=";
+bool tdmaSynced = false;
+unsigned long tdmaFrameStart = 0;
+long tdmaRemainder = 0;
+long tdmaDrift = 0;
+uint32_t tdmaFrame = 0;
+uint32_t tdmaUplinkFrame = 0;
+uint16_t tdmaFramesSinceBeacon = 0;
 
 /**
-    slashSign es el caracter "/" almacenado en una constante.
+    LoRaRxPacket es un slot de la cola de recepción LoRa: el mensaje recibido (terminado en nulo),
+    su longitud, el RSSI (en dBm) y el SNR (en dB) del paquete, y el valor de millis() al momento
+    de la interrupción RX_DONE. downlinkObserver() interpreta el mensaje en el propio slot.
 */
-const String slashSign = "/";
+struct LoRaRxPacket {
+    char data[INCOMING_FULL_MAX_SIZE + 1];
+    uint8_t length;
+    int16_t rssi;
+    float snr;
+    unsigned long timestamp;
+};
 
 /**
-    ampersandSign es el caracter "&" almacenado en una constante.
+    loraRxQueue es una cola circular de LORA_RX_QUEUE_SLOTS paquetes entre onReceive() (productor)
+    y downlinkObserver() (consumidor), de modo que un paquete que llega antes de procesar el
+    anterior no lo pise. Ambos corren en loop() (onReceive() desde LoRa.handleInterrupt(), ver
+    LoRa_helpers.h), nunca en una interrupción, así que los índices no necesitan ser volatile.
+    Cada pasada de loop() vacía el FIFO hasta tres veces antes de downlinkObserver() (al enviar un
+    reporte, en loop() y en LoRaTxObserver()), de ahí los tres slots por defecto.
+    Ambos índices recorren 0 a 2 * LORA_RX_QUEUE_SLOTS - 1 para distinguir la cola llena de la
+    vacía (ver loraRxQueued()).
 */
-const String ampersandSign = "&";
+LoRaRxPacket loraRxQueue[LORA_RX_QUEUE_SLOTS];
+uint8_t loraRxHead = 0;
+uint8_t loraRxTail = 0;
 
 /**
-    greaterSign es el caracter ">" almacenado en una constante.
+    loraRxOverflows cuenta los paquetes descartados por encontrar la cola de recepción llena.
 */
-const String greaterSign = ">";
+uint16_t loraRxOverflows = 0;
 
 /**
-    equalsPosition es un int que contiene la posición de la cadena '=' en una cadena de texto.
+    incomingPayload es una string que contiene sólo la carga útil del mensaje LoRa de entrada,
+    utilizada sólo cuando el identificador de nodo coincide con DEVICE_ID o con BROADCAST_ID.
 */
-int equalsPosition = 0;
+String incomingPayload;
 
 /**
-    slashPosition es un int que contiene la posición de la cadena '/' en una cadena de texto.
+    knownCommands es un array de Strings que contiene los comandos LoRa que
+    se pueden ejecutar.
 */
-int slashPosition = 0;
+const String knownCommands[KNOWN_COMMANDS_SIZE] = {
+    "startAlert",   // inicia una alerta con el siguiente llamado a función: startAlert(750, 10);
+    "daytime",      // alerta a la cabina que es de día.
+    "nighttime",    // alerta a la cabina que es de noche.
+    "adr=",         // fija el data rate y la potencia LoRa, o reanuda ADR (ver adr.h).
+    "sync"          // beacon del concentrador que marca el inicio de la trama TDMA (ver tdma.h).
+};
+
+/**
+    statusOutgoing es una string que puede tomar uno de los siguientes valores:
+    - 'S': cabina en servicio.
+    - 'L': cabina en modo limitado.
+    - 'F': cabina fuera de servicio.
+*/
+String statusOutcoming = "F";
 
 /**
-    ampersandPosition es un int que contiene la posición de la cadena '&' en una cadena de texto.
+    equalSign es el caracter "=" almacenado en una constante.
 */
-int ampersandPosition = 0;
+const String equalSign = "=";
+
+/**
+    equalsPosition es un int que contiene la posición de la cadena '=' en una cadena de texto.
+*/
+int equalsPosition = 0;
 
 /**
     outcomingUSB es una string que contiene el mensaje USB de salida hacia el proyecto SIGEFA.
@@ -220,10 +347,17 @@ bool outcomingMM = false;
 #include "pinout.h"             // Biblioteca propia.
 #include "alerts.h"             // Biblioteca propia.
 #include "timing_helpers.h"     // Biblioteca propia.
-#include "sensors.h"            // Biblioteca propia.
-#include "actuators.h"          // Biblioteca propia.
 #include "decimal_helpers.h"    // Biblioteca propia.
+#include "duty_cycle.h"         // Biblioteca propia.
+#include "tdma.h"               // Biblioteca propia.
 #include "array_helpers.h"      // Biblioteca propia.
+#include "sensor_registry.h"    // Biblioteca propia.
+#include "expansion.h"          // Biblioteca propia.
+#include "sensors.h"            // Biblioteca propia.
+#include "adr.h"                // Biblioteca propia.
+#include "lbt.h"                // Biblioteca propia.
+#include "lora_payload.h"       // Biblioteca propia.
+#include "actuators.h"          // Biblioteca propia.
 #include "LoRa_helpers.h"       // Biblioteca propia.
 
 /// Funciones principales.
@@ -234,13 +368,9 @@ bool outcomingMM = false;
     e inicia una alerta de falla.
 */
 void reserveMemory() {
-    receiverStr.reserve(DEVICE_ID_MAX_SIZE);
-    currentStr.reserve(8);
-    gasStr.reserve(8);
     incomingUSB.reserve(20);
     incomingUSBType.reserve(10);
     incomingPayload.reserve(INCOMING_PAYLOAD_MAX_SIZE);
-    incomingFull.reserve(INCOMING_FULL_MAX_SIZE);
     outcomingUSB.reserve(100);
 
     if (!outcomingFull.reserve(MAX_SIZE_OUTCOMING_LORA_REPORT)) {
@@ -255,7 +385,10 @@ void reserveMemory() {
 /**
     setup() lleva a cabo las siguientes tareas:
         - setea el pinout,
+        - habilita las interrupciones de la puerta y del botón antipánico,
+        - inicia el barrido del puerto de expansión,
         - inicializa el periférico serial,
+        - inicializa a los DS18B20,
         - reserva espacios de memoria para las Strings,
         - inicializa el módulo LoRa,
         - inicializa el watchdog timer en 8 segundos.
@@ -264,7 +397,10 @@ void reserveMemory() {
 */
 void setup() {
     setupPinout();
+    setupInputInterrupts();
+    setupExpansionPort();
     Serial.begin(SERIAL_BPS);
+    setupTemperatureProbes();
     #if DEBUG_LEVEL >= 1
         Serial.println("Nodo interior")
         Serial.println("");
@@ -295,11 +431,13 @@ void setup() {
 
 /**
     loop() determina las tareas que cumple el programa:
-        - cada LORA_TIMEOUT segundos, envía un payload LoRa y un payload USB.
-        - cada TIMEOUT_READ_SENSORS segundos, refresca el estado de todas las mediciones.
-        - si corresponde, mide tensión y temperatura.
+        - cada LORA_TIMEOUT segundos (en el slot TDMA del nodo), envía un payload LoRa (si entra en el presupuesto de ciclo
+        de trabajo; si no, lo difiere a la próxima vez) y un payload USB.
+        - cada TIMEOUT_READ_SENSORS segundos, actualiza el estado de las luces.
+        - refresca cada sensor del registro según su período y avanza las mediciones en curso.
         - observa el estado actual de las variables de programa y, de ser necesario, actúa:
             - emite las alertas que sean necesarias,
+            - vuelve a modo recepción LoRa cuando termina una transmisión,
             - ejecuta comandos entrantes de LoRa,
             - observa el estado de la puerta,
             - observa el estado del botón antipánico,
@@ -308,34 +446,79 @@ void setup() {
     Esta función se repite hasta que se le dé un reset al programa.
 */
 void loop() {
-    if (runEvery(sec2ms(LORA_TIMEOUT), 1)) {
-        // Deja de refrescar TODOS los sensores.
-        stopRefreshingAllSensors();
+    if (tdmaUplinkDue()) {
+        // Copia los enclavamientos de la emergencia y de la puerta con las interrupciones
+        // deshabilitadas: el reporte informa esa copia, y un evento enclavado después de la copia
+        // queda para el próximo reporte.
+        noInterrupts();
+        bool latched = emergencyLatched;
+        bool doorLatched = doorOpenedLatched;
+        interrupts();
+        bool reportEmergency = emergency || latched;
+        bool reportDoor = doorOpen || doorLatched;
 
         // Compone la carga útil de LoRa (en caso de que se vaya a reportar el estado de los 
-        // sensores, y no haya mensajes militares a emitir).
-        if (!outcomingMM) {
-            composeLoRaPayload(voltages, temperatures, emergency, statusOutcoming, outcomingFull);
+        // sensores, y no haya mensajes militares a emitir). Con un envío en curso no se toca:
+        // el paquete anterior se lee recién al terminar la escucha del canal.
+        if (!outcomingMM && loraTxState == LORA_TX_IDLE) {
+            #if LORA_BINARY_FRAME == TRUE
+                outcomingFrameSize = composeLoRaFrame(reportEmergency, reportDoor, statusOutcoming, outcomingFrame);
+            #else
+                composeLoRaPayload(reportEmergency, reportDoor, statusOutcoming, outcomingFull);
+            #endif
         }
 
         #if DEBUG_LEVEL >= 1
+            #if LORA_BINARY_FRAME == TRUE
+                if (!outcomingMM) {
+                    Serial.print("Trama LoRa encolada!: ");
+                    Serial.print(outcomingFrameSize);
+                    Serial.println(" bytes");
+                }
+            #endif
             Serial.print("Payload LoRa encolado!: ");
             Serial.println(outcomingFull);
         #endif
 
-        // Componer y enviar paquete.
-        LoRa.beginPacket();
-        LoRa.print(outcomingFull);
-        LoRa.endPacket();
+        // Aplica el data rate y la potencia que haya decidido ADR (o un comando de downlink).
+        if (loraTxState == LORA_TX_IDLE) {
+            adrApply();
+        }
+
+        // Tiempo en el aire del paquete con la configuración actual del módulo.
+        #if LORA_BINARY_FRAME == TRUE
+            // Los mensajes militares siempre viajan como texto.
+            unsigned long airtime = LoRa.timeOnAir(outcomingMM ? outcomingFull.length() : outcomingFrameSize);
+        #else
+            unsigned long airtime = LoRa.timeOnAir(outcomingFull.length());
+        #endif
 
-        // Pone al módulo LoRa en modo recepción.
-        LoRa.receive();
+        // Encolar el paquete (salvo que la transmisión anterior siga en curso, o que exceda el
+        // presupuesto de ciclo de trabajo; las emergencias no se difieren). No espera el fin de
+        // la transmisión: LoRaTxObserver() y las funciones de interrupción completan el envío.
+        bool queued = false;
+        if (loraTxState == LORA_TX_IDLE && (reportEmergency || dutyCycleAllows(airtime))) {
+            #if LORA_BINARY_FRAME == TRUE
+                LoRaSend(!outcomingMM, airtime);
+            #else
+                LoRaSend(false, airtime);
+            #endif
+            adrUplinkSent();
+            queued = true;
+        }
+        #if DEBUG_LEVEL >= 1
+            Serial.print("Tiempo en el aire: ");
+            Serial.print(airtime);
+            Serial.print(" ms, ciclo de trabajo: ");
+            Serial.print(dutyCycleUtilisation());
+            Serial.println(queued ? "% del presupuesto." : "% del presupuesto. Reporte diferido!");
+        #endif
 
         // Inicia la alerta preestablecida.
         startAlert(133, 3);
 
         // Compone la carga útil USB.
-        composeUSBPayload(voltages, temperatures, emergency, currentBuffer, gasBuffer, outcomingUSB);
+        composeUSBPayload(reportEmergency, reportDoor, currentBuffer, gasBuffer, outcomingUSB);
         #if DEBUG_LEVEL > 0
             Serial.print("Payload que saldría por USB: ");
         #endif
@@ -344,38 +527,42 @@ void loop() {
             Serial.println(outcomingUSB);
         #endif
 
-        // Reestablece los arrays de medición.
-        cleanupArray(voltages, ARRAY_SIZE);
-        cleanupArray(temperatures, ARRAY_SIZE);
-
-        // Reestablece el index de los arrays de medición.
-        index = 0;
-
-        // Baja el flag de mensaje militar.
-        outcomingMM = false;
+        // Si el reporte se difirió, las series, las fallas y el mensaje militar se conservan
+        // para la próxima transmisión.
+        if (queued) {
+            // Vacía las series de medición y el registro de fallas.
+            Sensors::clear();
+            sensorHealth = 0;
+
+            // Baja el flag de mensaje militar.
+            outcomingMM = false;
+
+            // La emergencia y la apertura enclavadas ya fueron reportadas: libera los enclavamientos.
+            if (latched) {
+                emergencyLatched = false;
+            }
+            if (doorLatched) {
+                doorOpenedLatched = false;
+            }
+        }
     }
 
     if(runEvery(sec2ms(TIMEOUT_READ_SENSORS), 3)) {
-        // Refresca TODOS los sensores.
-        refreshAllSensors();
         // Actualiza el estado de las luces.
         lightsObserver();
-        // Avanza en 1 a los índices de los arrays de medición.
-        index++;
     }
 
-    if (!resetAlert && !pitidosRestantes) {
-        if (refreshRequested[0]) {
-            // Obtiene un nuevo valor de tensión.
-            getNewVoltage();
-        }
-        if (refreshRequested[1]) {
-            // Obtiene un nuevo valor de temperatura.
-            getNewTemperature();
-        }
-    }
+    // Pide el refresco de los sensores cuyo período venció.
+    Sensors::schedule(millis());
+
+    // Avanza las mediciones en curso (no bloqueante).
+    Sensors::poll();
+
+    // Atiende la interrupción de DIO0 pendiente (RX_DONE / TX_DONE) fuera de la ISR.
+    LoRa.handleInterrupt();
 
     alertObserver();
+    LoRaTxObserver();
     downlinkObserver();
     LoRaCmdObserver();
     doorObserver();
@@ -393,12 +580,13 @@ void loop() {
 
 /*
     serialEvent() es la respuesta a la interrupción por puerto serie.
-    Al recibir el caracter newline (\n), se levanta un flag, incomingUSBComplete.
+    Al recibir el caracter newline (\n), se levanta un flag, incomingUSBComplete. Hasta que
+    usbObserver() atienda esa línea, los caracteres siguientes esperan en el buffer del puerto.
     incomingUSB típico:
         'USB: status=S\n'
 */
 void serialEvent() {
-    while (Serial.available()) {
+    while (!incomingUSBComplete && Serial.available()) {
         // obtener el nuevo caracter
         char inChar = (char)Serial.read();
         if (inChar == '\n') {
@@ -0,0 +1,151 @@
+/**
+    Reemplazo mínimo de Arduino.h para correr los tests en el host (env:native).
+    El tiempo no corre solo: los tests lo avanzan con mockMillis (o con delay()).
+    @file Arduino.h
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+#ifndef ARDUINO_MOCK_H
+#define ARDUINO_MOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define TRUE 1
+#define FALSE 0
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define MSBFIRST 1
+#define DEC 10
+#define HEX 16
+#define B111 7
+#define B1000 8
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define bit(b) (1UL << (b))
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : -1))
+#define noInterrupts()
+#define interrupts()
+
+/**
+    mockMillis es el valor que devuelve millis(); micros() devuelve mockMillis * 1000.
+*/
+extern unsigned long mockMillis;
+
+/**
+    mockIsr contiene la función registrada con attachInterrupt() en cada interrupción externa
+    (INT0 e INT1); los tests la llaman para simular el flanco.
+*/
+extern void (*mockIsr[2])(void);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t interrupt, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+/**
+    String guarda su texto en memoria dinámica, como la del core; sólo implementa lo que usan los
+    headers del firmware bajo test.
+*/
+class String {
+public:
+    String(const char* text = "") { assign(text); }
+    String(const String& other) { assign(other.text); }
+    ~String() { free(text); }
+    String& operator=(const String& other);
+    String& operator+=(const String& other) { return append(other.text); }
+    String& operator+=(const char* other) { return append(other); }
+    String& operator+=(char c);
+    String& operator+=(int n) { return *this += (long)n; }
+    String& operator+=(unsigned int n) { return *this += (unsigned long)n; }
+    String& operator+=(unsigned char n) { return *this += (unsigned long)n; }
+    String& operator+=(long n);
+    String& operator+=(unsigned long n);
+    bool operator==(const char* other) const { return strcmp(text, other) == 0; }
+    char operator[](unsigned int index) const { return index < length() ? text[index] : 0; }
+    unsigned int length() const { return strlen(text); }
+    const char* c_str() const { return text; }
+
+private:
+    char* text;
+    void assign(const char* other) { text = strdup(other); }
+    String& append(const char* other);
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t data) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+    size_t print(const char* str) { return write(str); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(int n, int base = DEC) { return print((long)n, base); }
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(double n, int digits = 2);
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(T value) { return print(value) + println(); }
+    template <typename T> size_t println(T value, int format) { return print(value, format) + println(); }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() {}
+    void setTimeout(unsigned long) {}
+};
+
+/**
+    HardwareSerial descarta todo lo que se escribe.
+*/
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long) {}
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    size_t write(uint8_t) { return 1; }
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
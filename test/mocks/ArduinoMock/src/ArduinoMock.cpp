@@ -0,0 +1,126 @@
+/**
+    Implementación del reemplazo del core de Arduino para correr los tests en el host.
+    @file ArduinoMock.cpp
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <stdio.h>
+
+unsigned long mockMillis = 0;
+void (*mockIsr[2])(void);
+HardwareSerial Serial;
+SPIClass SPI;
+
+unsigned long millis() {
+    return mockMillis;
+}
+
+unsigned long micros() {
+    return mockMillis * 1000;
+}
+
+void delay(unsigned long ms) {
+    mockMillis += ms;
+}
+
+void delayMicroseconds(unsigned int) {
+}
+
+void yield() {
+}
+
+void pinMode(uint8_t, uint8_t) {
+}
+
+void digitalWrite(uint8_t, uint8_t) {
+}
+
+int digitalRead(uint8_t) {
+    return LOW;
+}
+
+void attachInterrupt(uint8_t interrupt, void (*isr)(void), int) {
+    if (interrupt < 2) {
+        mockIsr[interrupt] = isr;
+    }
+}
+
+void detachInterrupt(uint8_t interrupt) {
+    if (interrupt < 2) {
+        mockIsr[interrupt] = NULL;
+    }
+}
+
+long random(long howbig) {
+    return howbig > 0 ? rand() % howbig : 0;
+}
+
+long random(long howsmall, long howbig) {
+    return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) {
+    srand(seed);
+}
+
+String& String::operator=(const String& other) {
+    if (this != &other) {
+        free(text);
+        assign(other.text);
+    }
+    return *this;
+}
+
+String& String::append(const char* other) {
+    size_t length = strlen(text);
+    text = (char*)realloc(text, length + strlen(other) + 1);
+    strcpy(text + length, other);
+    return *this;
+}
+
+String& String::operator+=(char c) {
+    char digits[2] = {c, 0};
+    return append(digits);
+}
+
+String& String::operator+=(long n) {
+    char digits[24];
+    snprintf(digits, sizeof(digits), "%ld", n);
+    return append(digits);
+}
+
+String& String::operator+=(unsigned long n) {
+    char digits[24];
+    snprintf(digits, sizeof(digits), "%lu", n);
+    return append(digits);
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while (size--) {
+        written += write(*buffer++);
+    }
+    return written;
+}
+
+size_t Print::print(long n, int base) {
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%lX" : "%ld", n);
+    return write(text);
+}
+
+size_t Print::print(unsigned long n, int base) {
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%lX" : "%lu", n);
+    return write(text);
+}
+
+size_t Print::print(double n, int digits) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.*f", digits, n);
+    return write(text);
+}
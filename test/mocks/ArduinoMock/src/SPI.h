@@ -0,0 +1,62 @@
+/**
+    Reemplazo mínimo de SPI.h para correr los tests en el host (env:native).
+    Cada byte transferido se entrega a SPI.device, que simula el periférico.
+    @file SPI.h
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+#ifndef SPI_MOCK_H
+#define SPI_MOCK_H
+
+#include <Arduino.h>
+
+#define SPI_MODE0 0
+
+class SPISettings {
+public:
+    SPISettings() {}
+    SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+class SPIClass {
+public:
+    void begin() {}
+    void end() {}
+    void usingInterrupt(uint8_t) {}
+    void notUsingInterrupt(uint8_t) {}
+
+    /**
+        beginTransaction() cuenta la transacción y reinicia la posición dentro de ella.
+    */
+    void beginTransaction(SPISettings) {
+        transactions++;
+        position = 0;
+    }
+
+    void endTransaction() {}
+
+    /**
+        transfer() entrega el byte al periférico simulado junto con su posición en la transacción.
+        @return Byte devuelto por el periférico (0 si no hay ninguno).
+    */
+    uint8_t transfer(uint8_t data) {
+        return device ? device(position++, data) : 0;
+    }
+
+    void transfer(void* buffer, size_t count) {
+        uint8_t* bytes = (uint8_t*)buffer;
+        for (size_t i = 0; i < count; i++) {
+            bytes[i] = transfer(bytes[i]);
+        }
+    }
+
+    uint8_t (*device)(size_t position, uint8_t data);
+    unsigned long transactions;
+    size_t position;
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,189 @@
+/**
+    Tests del acceso al canal sin coordinación (lbt.h): varios nodos que reportan a la vez, con y
+    sin escuchar el canal antes de transmitir. Se simula el tiempo en pasos de 1 ms.
+    @file test_main.cpp
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "constants.h"
+#include "lbt.h"
+
+#define NODES 8             // Nodos que compiten por el canal.
+#define START_SPREAD 1000   // Los nodos empiezan a reportar dentro de esta ventana (en ms).
+#define REPORT_AIRTIME 113  // Tiempo en el aire de un reporte de 60 bytes a SF7, 125 kHz (en ms).
+#define PREAMBLE_AIRTIME 13 // Tiempo en el aire del preámbulo (8 + 4,25 símbolos) a SF7, 125 kHz (en ms).
+#define CAD_TIME 2          // Duración de una detección de actividad a SF7, 125 kHz (en ms).
+#define TRIALS 500          // Repeticiones de cada escenario.
+
+/**
+    Node contiene el estado de un nodo: el instante en que vuelve a escuchar el canal (o en que
+    empieza a transmitir, sin LBT), las esperas hechas y el inicio de su transmisión (-1 si aún no).
+*/
+struct Node {
+    long nextCad;
+    uint8_t attempts;
+    long txStart;
+};
+
+/**
+    ChannelRun resume una simulación: reportes recibidos sin colisión y la mayor demora desde el
+    pedido de reporte hasta el comienzo de la transmisión (en ms).
+*/
+struct ChannelRun {
+    int delivered;
+    int transmitted;
+    long worstDelay;
+};
+
+/**
+    channelBusy() indica si algún otro nodo transmite durante el CAD de node, que termina en now.
+    @param wholePacket true si el CAD detecta el paquete entero; false si sólo detecta el preámbulo.
+    @param jammed true si un transmisor ajeno ocupa el canal todo el tiempo.
+*/
+bool channelBusy(const Node* nodes, int node, long now, bool wholePacket, bool jammed) {
+    if (jammed) {
+        return true;
+    }
+    long detectable = wholePacket ? REPORT_AIRTIME : PREAMBLE_AIRTIME;
+    for (int i = 0; i < NODES; i++) {
+        if (i == node || nodes[i].txStart < 0) {
+            continue;
+        }
+        if (nodes[i].txStart < now && nodes[i].txStart + detectable > now - CAD_TIME) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+    simulate() corre TRIALS veces NODES reportes, pedidos en instantes aleatorios dentro de
+    START_SPREAD ms, y cuenta los que no se superponen con ningún otro.
+    @param lbt true para escuchar el canal con la política de lbt.h; false para ALOHA puro.
+*/
+ChannelRun simulate(bool lbt, bool wholePacket = true, bool jammed = false) {
+    ChannelRun run = {0, 0, 0};
+    randomSeed(1);
+    for (int trial = 0; trial < TRIALS; trial++) {
+        Node nodes[NODES];
+        long requested[NODES];
+        for (int i = 0; i < NODES; i++) {
+            requested[i] = random(START_SPREAD);
+            nodes[i].nextCad = requested[i];
+            nodes[i].attempts = 0;
+            nodes[i].txStart = -1;
+        }
+        int pending = NODES;
+        for (long now = 0; pending > 0; now++) {
+            for (int i = 0; i < NODES; i++) {
+                Node& node = nodes[i];
+                if (node.txStart >= 0 || now < node.nextCad + (lbt ? CAD_TIME : 0)) {
+                    continue;
+                }
+                if (lbt && lbtRetry(channelBusy(nodes, i, now, wholePacket, jammed), node.attempts)) {
+                    node.nextCad = now + lbtBackoff(++node.attempts);
+                    continue;
+                }
+                node.txStart = now;
+                pending--;
+                run.worstDelay = max(run.worstDelay, now - requested[i]);
+            }
+        }
+        for (int i = 0; i < NODES; i++) {
+            bool collided = false;
+            for (int j = 0; j < NODES; j++) {
+                if (j != i && labs(nodes[i].txStart - nodes[j].txStart) < REPORT_AIRTIME) {
+                    collided = true;
+                }
+            }
+            run.transmitted++;
+            if (!collided) {
+                run.delivered++;
+            }
+        }
+    }
+    return run;
+}
+
+/**
+    maxDelay() devuelve la mayor demora posible con LBT: un CAD por intento más la espera máxima
+    de cada uno.
+*/
+long maxDelay() {
+    long delay = (long)CAD_TIME * (LORA_LBT_ATTEMPTS + 1);
+    for (uint8_t attempt = 1; attempt <= LORA_LBT_ATTEMPTS; attempt++) {
+        delay += (long)LORA_LBT_SLOT << attempt;
+    }
+    return delay;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+/**
+    Con el CAD detectando el paquete entero, LBT entrega bastante más reportes que ALOHA.
+*/
+void test_lbt_reduces_collisions() {
+    ChannelRun aloha = simulate(false);
+    ChannelRun lbt = simulate(true);
+    TEST_ASSERT_EQUAL(NODES * TRIALS, aloha.transmitted);
+    TEST_ASSERT_EQUAL(NODES * TRIALS, lbt.transmitted);
+    TEST_ASSERT_TRUE(aloha.delivered < NODES * TRIALS / 3);
+    TEST_ASSERT_TRUE(lbt.delivered > NODES * TRIALS * 3 / 4);
+    TEST_ASSERT_TRUE(lbt.delivered > 2 * aloha.delivered);
+    TEST_ASSERT_TRUE(lbt.worstDelay <= maxDelay());
+}
+
+/**
+    Si el CAD sólo detecta preámbulos (SX127x con señal débil), LBT ayuda menos pero nunca entrega
+    menos reportes que ALOHA.
+*/
+void test_lbt_preamble_only() {
+    ChannelRun aloha = simulate(false);
+    ChannelRun lbt = simulate(true, false);
+    TEST_ASSERT_TRUE(lbt.delivered >= aloha.delivered);
+}
+
+/**
+    Con el canal ocupado todo el tiempo, cada nodo transmite igual luego de LORA_LBT_ATTEMPTS
+    esperas, dentro de la demora máxima.
+*/
+void test_busy_channel_gives_up() {
+    ChannelRun lbt = simulate(true, true, true);
+    TEST_ASSERT_EQUAL(NODES * TRIALS, lbt.transmitted);
+    TEST_ASSERT_TRUE(lbt.worstDelay <= maxDelay());
+    TEST_ASSERT_TRUE(lbt.worstDelay >= (long)LORA_LBT_SLOT * LORA_LBT_ATTEMPTS);
+}
+
+/**
+    lbtBackoff() sortea dentro de [LORA_LBT_SLOT, LORA_LBT_SLOT * 2^n) en el n-ésimo intento.
+*/
+void test_backoff_bounds() {
+    randomSeed(2);
+    for (uint8_t attempt = 1; attempt <= LORA_LBT_ATTEMPTS; attempt++) {
+        for (int i = 0; i < 1000; i++) {
+            unsigned long backoff = lbtBackoff(attempt);
+            TEST_ASSERT_TRUE(backoff >= LORA_LBT_SLOT);
+            TEST_ASSERT_TRUE(backoff < ((unsigned long)LORA_LBT_SLOT << attempt));
+        }
+    }
+    TEST_ASSERT_FALSE(lbtRetry(false, 0));
+    TEST_ASSERT_TRUE(lbtRetry(true, LORA_LBT_ATTEMPTS - 1));
+    TEST_ASSERT_FALSE(lbtRetry(true, LORA_LBT_ATTEMPTS));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_lbt_reduces_collisions);
+    RUN_TEST(test_lbt_preamble_only);
+    RUN_TEST(test_busy_channel_gives_up);
+    RUN_TEST(test_backoff_bounds);
+    return UNITY_END();
+}
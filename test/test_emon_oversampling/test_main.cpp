@@ -0,0 +1,184 @@
+/**
+    Banco de pruebas del muestreo por software de EmonLib (EMON_SAMPLE_RATE 0): sobremuestreo de
+    tensión (EMON_OVERSAMPLING_BITS) y frecuencia de línea con la ventana repartida en varias
+    pasadas. EmonLib.cpp corre en el host sobre un ADC simulado: cada conversión dura
+    ADC_CONVERSION_US y lee una onda sintética de línea con ruido gaussiano y, opcionalmente, un
+    tercer armónico. Para cada cantidad de bits se reporta la tensión eficaz medida, su dispersión
+    entre ventanas y el tiempo que toma cada ventana. La aritmética de sampleVI() no se cronometra:
+    las muestras por ventana con 0 y 1 bits son una cota superior de las que toma un ATmega328.
+    @file test_main.cpp
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+#include <Arduino.h>
+#include <stdio.h>
+#include "constants.h"
+
+#define ARDUINO 10813
+#define ADC_CONVERSION_US 112 // 13 ciclos del ADC a 125 kHz más el resto de analogRead() (en us).
+#define SUPPLY_MV 3300        // Lo que devuelve readVcc() fuera de un AVR (en mV).
+#define PIN_V 2               // Entrada de tensión.
+#define PIN_I 1               // Entrada de corriente (sin carga: medio rango).
+#define NOISE_LSB 0.7         // Desvío del ruido del ADC (en cuentas).
+#define WINDOWS 40            // Ventanas medidas por configuración.
+
+unsigned long simUs;
+unsigned long simConversions;
+double simVrms;  // Tensión eficaz de la onda simulada (en V).
+double simThird; // Amplitud del tercer armónico respecto de la fundamental.
+
+/**
+    gaussian() sortea una muestra normal estándar (Box-Muller).
+*/
+double gaussian() {
+    double u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+/**
+    simAnalogRead() reemplaza a analogRead(): avanza el reloj una conversión y cuantiza la onda
+    en ese instante, escalada como lo hace finishVI() con EMON_VOLTAGE_CAL y SUPPLY_MV.
+*/
+int simAnalogRead(uint8_t pin) {
+    simUs += ADC_CONVERSION_US;
+    simConversions++;
+    if (pin != PIN_V) {
+        return 512;
+    }
+    double voltsPerCount = EMON_VOLTAGE_CAL * (SUPPLY_MV / 1000.0) / 1024;
+    double peak = simVrms * sqrt(2) / sqrt(1 + simThird * simThird) / voltsPerCount;
+    double t = simUs / 1e6;
+    double wave = sin(2 * M_PI * EMON_MAINS_FREQ * t) + simThird * sin(2 * M_PI * 3 * EMON_MAINS_FREQ * t);
+    long count = lround(512 + peak * wave + NOISE_LSB * gaussian());
+    return constrain(count, 0, 1023);
+}
+
+#define analogRead(pin) simAnalogRead(pin)
+#define micros() (simUs)
+#define millis() (simUs / 1000)
+#pragma GCC diagnostic ignored "-Wunused-variable" // readVcc() fuera de un AVR.
+#include "../../lib/EmonLib-master/EmonLib.cpp"
+#include <unity.h>
+
+/**
+    OversamplingRun resume las ventanas medidas con una configuración: la tensión eficaz media y
+    su desvío (en V), y el tiempo y las conversiones por ventana.
+*/
+struct OversamplingRun {
+    double mean;
+    double deviation;
+    double windowMs;
+    unsigned long conversions;
+};
+
+/**
+    measure() mide WINDOWS ventanas de EMON_CROSSINGS semi-ondas con bits de sobremuestreo.
+*/
+OversamplingRun measure(unsigned int bits, double vrms, double third = 0) {
+    srand(1);
+    simVrms = vrms;
+    simThird = third;
+    EnergyMonitor eMon;
+    eMon.voltage(PIN_V, EMON_VOLTAGE_CAL, EMON_PHASE_CAL);
+    eMon.current(PIN_I, 1);
+    eMon.voltageOversampling(bits);
+    eMon.calcVI(EMON_CROSSINGS, EMON_TIMEOUT); // Asienta el filtro del offset.
+    unsigned long startUs = simUs;
+    unsigned long startConversions = simConversions;
+    double sum = 0;
+    double sumSq = 0;
+    for (int i = 0; i < WINDOWS; i++) {
+        eMon.calcVI(EMON_CROSSINGS, EMON_TIMEOUT);
+        sum += eMon.Vrms;
+        sumSq += eMon.Vrms * eMon.Vrms;
+    }
+    OversamplingRun run;
+    run.mean = sum / WINDOWS;
+    run.deviation = sqrt(max(0.0, sumSq / WINDOWS - run.mean * run.mean));
+    run.windowMs = (simUs - startUs) / 1000.0 / WINDOWS;
+    run.conversions = (simConversions - startConversions) / WINDOWS;
+    printf("bits %u, %2lu conv/muestra: Vrms %7.2f V (error %+6.2f %%, desvío %.3f V), %5.1f ms y %4lu conversiones por ventana\n",
+           bits, 1UL << (2 * bits), run.mean, 100 * (run.mean - vrms) / vrms, run.deviation,
+           run.windowMs, run.conversions);
+    return run;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+/**
+    Sobre una senoidal pura y sobre una con 5 % de tercer armónico: sin sobremuestreo o con un
+    bit, la tensión eficaz queda a menos de 0,5 % y varía menos de 0,1 V entre ventanas. Cada
+    muestra sobremuestreada promedia 4^n conversiones seguidas, es decir, un tramo de la onda: con
+    2 bits (1,8 ms) ya la atenúa más del 1 %, y con 3 (7,2 ms) más del 10 %, sin mejorar la
+    dispersión, porque la tensión eficaz ya promedia el ruido de cientos de muestras.
+*/
+void test_resolution_against_time(void) {
+    const double thirds[] = {0, 0.05};
+    for (uint8_t w = 0; w < 2; w++) {
+        OversamplingRun runs[4];
+        for (unsigned int bits = 0; bits <= 3; bits++) {
+            runs[bits] = measure(bits, 230, thirds[w]);
+        }
+        for (unsigned int bits = 0; bits <= 1; bits++) {
+            TEST_ASSERT_TRUE(fabs(runs[bits].mean - 230) < 230 * 0.005);
+            TEST_ASSERT_TRUE(runs[bits].deviation < 0.1);
+        }
+        TEST_ASSERT_TRUE(runs[2].mean < 230 * 0.99);
+        TEST_ASSERT_TRUE(runs[3].mean < 230 * 0.9);
+        TEST_ASSERT_TRUE(runs[3].windowMs > runs[0].windowMs);
+        TEST_ASSERT_TRUE(runs[3].deviation > runs[0].deviation / 2);
+    }
+}
+
+/**
+    Un hueco de 2 V se distingue con 0 y 1 bits: la diferencia medida entre ventanas está a menos
+    de 0,2 V de la real.
+*/
+void test_sag_resolution(void) {
+    for (unsigned int bits = 0; bits <= 1; bits++) {
+        double nominal = measure(bits, 230).mean;
+        double sag = measure(bits, 228).mean;
+        TEST_ASSERT_TRUE(fabs((nominal - sag) - 2) < 0.2);
+    }
+}
+
+/**
+    La frecuencia se mide de una ventana muestreada de una vez; si la ventana se reparte entre
+    pasadas de loop() (EMON_STEP_BUDGET), los cruces de los huecos se pierden (con estos huecos
+    se medían 28 Hz) y se informa 0. La tensión eficaz no depende de los cruces perdidos.
+*/
+void test_frequency_only_from_whole_windows(void) {
+    simVrms = 230;
+    simThird = 0;
+    EnergyMonitor eMon;
+    eMon.voltage(PIN_V, EMON_VOLTAGE_CAL, EMON_PHASE_CAL);
+    eMon.current(PIN_I, 1);
+    eMon.voltageOversampling(0);
+    eMon.calcVI(EMON_CROSSINGS, EMON_TIMEOUT);
+    eMon.calcVI(EMON_CROSSINGS, EMON_TIMEOUT);
+    TEST_ASSERT_TRUE(fabs(eMon.frequency - EMON_MAINS_FREQ) < EMON_MAINS_FREQ * 0.005);
+
+    eMon.begin(EMON_CROSSINGS, EMON_TIMEOUT);
+    while (!eMon.ready()) {
+        eMon.step(EMON_STEP_BUDGET);
+        simUs += 12300; // El resto de loop(), más que media onda: se pierden cruces enteros.
+    }
+    TEST_ASSERT_FALSE(eMon.timedOut);
+    TEST_ASSERT_EQUAL(0, eMon.frequency);
+    TEST_ASSERT_TRUE(fabs(eMon.result() - 230) < 230 * 0.01);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_resolution_against_time);
+    RUN_TEST(test_sag_resolution);
+    RUN_TEST(test_frequency_only_from_whole_windows);
+    return UNITY_END();
+}
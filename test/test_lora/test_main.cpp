@@ -0,0 +1,225 @@
+/**
+    Tests de la librería LoRa contra un SX1278 simulado detrás del SPI del mock.
+    @file test_main.cpp
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <LoRa.h>
+#include <unity.h>
+
+/**
+    El SX1278 simulado tiene un archivo de 128 registros y un FIFO de 256 bytes. Escribir 1 en
+    un bit de RegIrqFlags lo borra. Pasar a modo TX termina la transmisión en el acto: levanta
+    TX_DONE y vuelve a standby; pasar a modo CAD levanta CAD_DONE (canal libre) y vuelve a standby. Los accesos a RegFifo avanzan RegFifoAddrPtr.
+*/
+uint8_t radioRegisters[128];
+uint8_t radioFifo[256];
+uint8_t radioAddress;
+bool radioWrite;
+unsigned int radioReads[128];
+
+uint8_t radioTransfer(size_t position, uint8_t data) {
+    if (position == 0) {
+        radioAddress = data & 0x7f;
+        radioWrite = data & 0x80;
+        return 0;
+    }
+    uint8_t address = radioAddress;
+    if (address == 0x00) {
+        uint8_t& slot = radioFifo[radioRegisters[0x0d]++];
+        if (radioWrite) {
+            slot = data;
+        }
+        return slot;
+    }
+    // Fuera del FIFO, las ráfagas avanzan de registro.
+    radioAddress++;
+    if (!radioWrite) {
+        radioReads[address]++;
+        return radioRegisters[address];
+    }
+    if (address == 0x12) {
+        radioRegisters[address] &= ~data;
+    } else if (address == 0x01 && (data & 0x07) == 0x03) {
+        radioRegisters[0x12] |= 0x08;
+        radioRegisters[address] = (data & ~0x07) | 0x01;
+    } else if (address == 0x01 && (data & 0x07) == 0x07) {
+        radioRegisters[0x12] |= 0x04;
+        radioRegisters[address] = (data & ~0x07) | 0x01;
+    } else {
+        radioRegisters[address] = data;
+    }
+    return 0;
+}
+
+/**
+    radioReceive() simula la recepción de un paquete: lo deja en el FIFO desde la dirección 0,
+    levanta RX_DONE y dispara la interrupción de DIO0.
+*/
+void radioReceive(const char* packet) {
+    uint8_t length = strlen(packet);
+    memcpy(radioFifo, packet, length);
+    radioRegisters[0x10] = 0;
+    radioRegisters[0x13] = length;
+    radioRegisters[0x12] |= 0x40;
+    mockIsr[digitalPinToInterrupt(2)]();
+}
+
+int received;
+char receivedData[32];
+int transmitted;
+int cadDone;
+
+void onReceive(int packetSize) {
+    received++;
+    size_t length = LoRa.readBytes((uint8_t*)receivedData, sizeof(receivedData) - 1);
+    receivedData[length] = '\0';
+}
+
+void onTxDone() {
+    transmitted++;
+}
+
+void onCadDone(boolean detected) {
+    cadDone++;
+}
+
+/**
+    sendPacket() transmite un paquete sin esperar el fin de la transmisión, como el firmware.
+*/
+void sendPacket(const char* packet) {
+    TEST_ASSERT_TRUE(LoRa.beginPacket());
+    LoRa.print(packet);
+    LoRa.endPacket(true);
+}
+
+void setUp(void) {
+    memset(radioRegisters, 0, sizeof(radioRegisters));
+    memset(radioFifo, 0, sizeof(radioFifo));
+    memset(radioReads, 0, sizeof(radioReads));
+    radioRegisters[0x42] = 0x12;
+    SPI.device = radioTransfer;
+    received = 0;
+    receivedData[0] = '\0';
+    transmitted = 0;
+    cadDone = 0;
+
+    LoRa.setPins(10, -1, 2);
+    TEST_ASSERT_TRUE(LoRa.begin(433175000));
+    LoRa.onReceive(onReceive);
+    LoRa.onTxDone(onTxDone);
+    LoRa.receive();
+}
+
+void tearDown(void) {
+    LoRa.end();
+}
+
+/**
+    Un paquete atendido antes de beginPacket() se entrega entero, y TX_DONE llega después.
+*/
+void test_receive_drained_before_transmit(void) {
+    radioReceive("<10009>sync");
+    TEST_ASSERT_TRUE(LoRa.handleInterrupt());
+    TEST_ASSERT_EQUAL(1, received);
+    TEST_ASSERT_EQUAL_STRING("<10009>sync", receivedData);
+
+    sendPacket("<10009>status=S");
+    mockIsr[digitalPinToInterrupt(2)]();
+    TEST_ASSERT_TRUE(LoRa.handleInterrupt());
+    TEST_ASSERT_EQUAL(1, received);
+    TEST_ASSERT_EQUAL(1, transmitted);
+}
+
+/**
+    Si RX_DONE sigue pendiente cuando termina una transmisión, el FIFO ya contiene el paquete
+    propio: no se entrega como recibido, pero TX_DONE sí se informa.
+*/
+void test_tx_done_with_stale_rx_done(void) {
+    radioReceive("<10009>sync");
+    sendPacket("<10009>status=S");
+    TEST_ASSERT_TRUE(LoRa.handleInterrupt());
+    TEST_ASSERT_EQUAL(0, received);
+    TEST_ASSERT_EQUAL(1, transmitted);
+    TEST_ASSERT_FALSE(LoRa.handleInterrupt());
+}
+
+/**
+    Si RX_DONE sigue pendiente cuando termina una detección de actividad, el paquete sigue en el
+    FIFO (el CAD no lo toca): se entrega entero, antes de informar CAD_DONE.
+*/
+void test_rx_done_with_cad_done(void) {
+    LoRa.onCadDone(onCadDone);
+    radioReceive("<10009>sync");
+    LoRa.channelActivityDetection();
+    mockIsr[digitalPinToInterrupt(2)]();
+    TEST_ASSERT_TRUE(LoRa.handleInterrupt());
+    TEST_ASSERT_EQUAL(1, received);
+    TEST_ASSERT_EQUAL_STRING("<10009>sync", receivedData);
+    TEST_ASSERT_EQUAL(1, cadDone);
+    TEST_ASSERT_FALSE(LoRa.handleInterrupt());
+}
+
+/**
+    uplinkTransactions() transmite un reporte como el firmware (LoRaTransmit(), TX_DONE atendido
+    en loop() y vuelta a recepción) y devuelve las transacciones SPI que costó.
+*/
+unsigned long uplinkTransactions() {
+    unsigned long start = LoRa.spiTransactions();
+    TEST_ASSERT_FALSE(LoRa.handleInterrupt());
+    sendPacket("<10009>voltage=225.00&temperature=24.50&health=0&status=S");
+    mockIsr[digitalPinToInterrupt(2)]();
+    TEST_ASSERT_TRUE(LoRa.handleInterrupt());
+    LoRa.receive();
+    TEST_ASSERT_EQUAL(SPI.transactions - start, LoRa.spiTransactions() - start);
+    return LoRa.spiTransactions() - start;
+}
+
+/**
+    Con los registros de configuración espejados, un reporte cuesta 12 transacciones SPI: 10 del
+    envío y la vuelta a recepción, y 2 de atender TX_DONE. Sin el espejo costaba 17 (15 + 2).
+    Ninguna lee un registro de configuración.
+*/
+void test_uplink_spi_transactions(void) {
+    uplinkTransactions();
+    memset(radioReads, 0, sizeof(radioReads));
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(12, uplinkTransactions());
+    }
+    TEST_ASSERT_EQUAL(0, radioReads[0x01]);
+    TEST_ASSERT_EQUAL(0, radioReads[0x1d]);
+    TEST_ASSERT_EQUAL(0, radioReads[0x1e]);
+    TEST_ASSERT_EQUAL(0, radioReads[0x22]);
+    TEST_ASSERT_EQUAL(0, radioReads[0x26]);
+    TEST_ASSERT_EQUAL(0, radioReads[0x40]);
+}
+
+/**
+    Reconfigurar con los mismos valores, o consultar la configuración, no accede al módulo.
+*/
+void test_configuration_from_shadow(void) {
+    LoRa.setSpreadingFactor(7);
+    LoRa.setSignalBandwidth(125E3);
+    LoRa.setSyncWord(0x34);
+    LoRa.timeOnAir(20);
+    unsigned long start = LoRa.spiTransactions();
+    LoRa.setSpreadingFactor(7);
+    LoRa.setSignalBandwidth(125E3);
+    LoRa.setSyncWord(0x34);
+    LoRa.timeOnAir(20);
+    TEST_ASSERT_EQUAL(0, LoRa.spiTransactions() - start);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_receive_drained_before_transmit);
+    RUN_TEST(test_tx_done_with_stale_rx_done);
+    RUN_TEST(test_rx_done_with_cad_done);
+    RUN_TEST(test_uplink_spi_transactions);
+    RUN_TEST(test_configuration_from_shadow);
+    return UNITY_END();
+}
@@ -0,0 +1,271 @@
+/**
+    Tests de ida y vuelta de la trama binaria LoRa (lora_payload.h): a partir de las mismas series
+    se componen el payload de texto y la trama, se decodifica la trama con la lógica de
+    tools/lora_frame.py y se verifica que ambos reportes coincidan. Los drivers son falsos, con los
+    mismos canales, nombres y bits de salud que los de sensors.h.
+    @file test_main.cpp
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+#include <string>
+#include <Arduino.h>
+#include <unity.h>
+#include "constants.h"
+#include "timing_helpers.h"
+#include "decimal_helpers.h"
+#include "array_helpers.h"
+#include "sensor_registry.h"
+
+uint8_t sensorHealth;
+uint8_t probesFound; // Sondas reportadas (como temperatureProbesFound).
+uint8_t analogMask;  // Canales del puerto de expansión reportados (como EXPANSION_MASK).
+
+/**
+    FakeSensor es un driver sin mediciones (las series se cargan directamente): sólo declara la
+    forma de un sensor de sensors.h. Sus muestras están en su unidad (V, Hz, °C, etc.).
+*/
+template <uint8_t Channels, uint8_t HealthEmpty>
+struct FakeSensor {
+    typedef float Sample;
+    static const uint8_t CHANNELS = Channels;
+    static const int PERIOD = 1;
+    static const int PHASE = 0;
+    static const uint8_t HEALTH_EMPTY = HealthEmpty;
+
+    static int32_t hundredths(Sample value) {
+        return (int32_t)(value * 100 + (value >= 0 ? 0.5 : -0.5));
+    }
+};
+
+struct FakeVoltage : FakeSensor<4, HEALTH_TENSION_SIN_DATOS> {
+    static bool reported(uint8_t channel) {
+        return true;
+    }
+
+    static void name(uint8_t channel, String& rtn) {
+        static const char* const names[CHANNELS] = { "voltage", "frequency", "crest", "distortion" };
+        rtn += names[channel];
+    }
+};
+
+struct FakeTemperature : FakeSensor<TEMPERATURA_PROBES, HEALTH_TEMPERATURA_SIN_DATOS> {
+    static bool reported(uint8_t channel) {
+        return channel == 0 || channel < probesFound;
+    }
+
+    static void name(uint8_t channel, String& rtn) {
+        rtn += "temperature";
+        if (channel > 0) {
+            rtn += (channel + 1);
+        }
+    }
+};
+
+struct FakeExpansion : FakeSensor<EXPANSION_CHANNELS, HEALTH_EXPANSION_SIN_DATOS> {
+    static bool reported(uint8_t channel) {
+        return bitRead(analogMask, channel);
+    }
+
+    static void name(uint8_t channel, String& rtn) {
+        static const char* const names[CHANNELS] = EXPANSION_NOMBRES;
+        rtn += names[channel];
+    }
+};
+
+typedef SensorRegistry<FakeVoltage, FakeTemperature, FakeExpansion> Sensors;
+
+#include "lora_payload.h"
+
+/**
+    channelName() agrega a rtn el nombre del canal del bit dado, como channels() de
+    tools/lora_frame.py: cuatro de tensión, probes de temperatura y los de expansión.
+    @return false si el bit está fuera del mapa.
+*/
+bool channelName(uint8_t bit, uint8_t probes, String& rtn) {
+    static const char* const voltage[] = { "voltage", "frequency", "crest", "distortion" };
+    static const char* const analog[] = EXPANSION_NOMBRES;
+    if (bit < 4) {
+        rtn += voltage[bit];
+    } else if (bit < 4 + probes) {
+        FakeTemperature::name(bit - 4, rtn);
+    } else if (bit < 4 + probes + EXPANSION_CHANNELS) {
+        rtn += analog[bit - 4 - probes];
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+    decodeFrame() decodifica la trama como decode() de tools/lora_frame.py y la escribe con el
+    formato del payload de texto (sólo con los canales presentes).
+    @return String vacía si la trama no es válida.
+*/
+String decodeFrame(const uint8_t frame[], uint8_t size, uint8_t probes) {
+    if (size < 7 || frame[0] != LORA_FRAME_VERSION) {
+        return "";
+    }
+    uint16_t present = frame[5] | (frame[6] << 8);
+    String rtn = "<";
+    rtn += (unsigned long)(frame[1] | (frame[2] << 8));
+    rtn += ">";
+    uint8_t offset = 7;
+    for (uint8_t bit = 0; bit < 16; bit++) {
+        if (!bitRead(present, bit)) {
+            continue;
+        }
+        if (offset + 2 > size || !channelName(bit, probes, rtn)) {
+            return "";
+        }
+        rtn += "=";
+        appendFixedPoint(rtn, (int16_t)(frame[offset] | (frame[offset + 1] << 8)));
+        rtn += "&";
+        offset += 2;
+    }
+    if (offset != size) {
+        return "";
+    }
+    rtn += "health=";
+    rtn += frame[4];
+    rtn += "&door=";
+    rtn += bitRead(frame[3], 3) ? "1" : "0";
+    rtn += "&status=";
+    rtn += "SLF"[frame[3] & 0x03];
+    return rtn;
+}
+
+/**
+    withoutMissing() quita del payload de texto los campos sin muestras ("=nan"), que la trama
+    omite.
+*/
+std::string withoutMissing(const String& payload) {
+    std::string text = payload.c_str();
+    size_t nan;
+    while ((nan = text.find("=nan&")) != std::string::npos) {
+        size_t start = text.find_last_of("&>", nan) + 1;
+        text.erase(start, nan + 5 - start);
+    }
+    return text;
+}
+
+/**
+    load() carga en un canal count muestras que promedian value.
+*/
+template <typename Driver>
+void load(uint8_t ch, float value, uint16_t count = 2) {
+    SensorSeries<Driver>::sum[ch] = value * count;
+    SensorSeries<Driver>::count[ch] = count;
+}
+
+/**
+    roundTrip() compone ambos reportes, decodifica la trama y verifica que coincidan.
+    @return Tamaño de la trama.
+*/
+uint8_t roundTrip(bool emergency, bool door, String status, uint8_t frame[]) {
+    String payload;
+    composeLoRaPayload(emergency, door, status, payload);
+    uint8_t size = composeLoRaFrame(emergency, door, status, frame);
+    TEST_ASSERT_TRUE(size <= LORA_FRAME_MAX_SIZE);
+    String decoded = decodeFrame(frame, size, TEMPERATURA_PROBES);
+    TEST_ASSERT_EQUAL_STRING(withoutMissing(payload).c_str(), decoded.c_str());
+    return size;
+}
+
+void setUp(void) {
+    Sensors::clear();
+    sensorHealth = 0;
+    probesFound = 1;
+    analogMask = 0;
+    // Sin canales de expansión reportados, el puerto no marca falta de datos (como si no
+    // estuviera registrado).
+    load<FakeExpansion>(0, 0);
+}
+
+void tearDown(void) {
+}
+
+/**
+    El ejemplo de docs/Trama binaria LoRa.md, byte a byte y en texto.
+*/
+void test_documented_example() {
+    const uint8_t expected[] = {0x01, 0x19, 0x27, 0x00, 0x00, 0x1F, 0x00, 0xE4, 0x57, 0x89, 0x13,
+                                0x8D, 0x00, 0x03, 0x00, 0x92, 0x09};
+    load<FakeVoltage>(0, 225.00);
+    load<FakeVoltage>(1, 50.01);
+    load<FakeVoltage>(2, 1.41);
+    load<FakeVoltage>(3, 0.03);
+    load<FakeTemperature>(0, 24.50);
+    String payload;
+    composeLoRaPayload(false, false, "S", payload);
+    TEST_ASSERT_EQUAL_STRING("<10009>voltage=225.00&frequency=50.01&crest=1.41&distortion=0.03&temperature=24.50&health=0&door=0&status=S", payload.c_str());
+    uint8_t frame[LORA_FRAME_MAX_SIZE];
+    TEST_ASSERT_EQUAL(sizeof(expected), roundTrip(false, false, "S", frame));
+    for (uint8_t i = 0; i < sizeof(expected); i++) {
+        TEST_ASSERT_EQUAL(expected[i], frame[i]);
+    }
+}
+
+/**
+    Todas las sondas y canales de expansión alternados, con valores negativos: cada canal cae en
+    el bit que le asigna el mapa con TEMPERATURA_PROBES sondas. Con otra cantidad de sondas, los
+    canales de expansión se decodifican con otro nombre.
+*/
+void test_all_channels() {
+    probesFound = TEMPERATURA_PROBES;
+    analogMask = 0b10101;
+    for (uint8_t ch = 0; ch < 4; ch++) {
+        load<FakeVoltage>(ch, 10.01 * (ch + 1));
+    }
+    for (uint8_t ch = 0; ch < TEMPERATURA_PROBES; ch++) {
+        load<FakeTemperature>(ch, -10.05 + 10 * ch);
+    }
+    for (uint8_t ch = 0; ch < EXPANSION_CHANNELS; ch++) {
+        load<FakeExpansion>(ch, ch + 0.07);
+    }
+    uint8_t frame[LORA_FRAME_MAX_SIZE];
+    uint8_t size = roundTrip(false, true, "L", frame);
+    TEST_ASSERT_EQUAL(7 + 2 * (4 + TEMPERATURA_PROBES + 3), size);
+
+    String payload;
+    composeLoRaPayload(false, true, "L", payload);
+    String wrongMap = decodeFrame(frame, size, TEMPERATURA_PROBES - 1);
+    TEST_ASSERT_TRUE(withoutMissing(payload) != wrongMap.c_str());
+}
+
+/**
+    Un canal sin muestras se omite en la trama ("nan" en texto) y la salud lo indica; la
+    emergencia fuerza el status F.
+*/
+void test_missing_channels_and_emergency() {
+    probesFound = 2;
+    load<FakeVoltage>(0, 230.12);
+    load<FakeTemperature>(1, 30.50);
+    bitSet(sensorHealth, HEALTH_TENSION_TIMEOUT);
+    uint8_t frame[LORA_FRAME_MAX_SIZE];
+    roundTrip(true, false, "S", frame);
+    TEST_ASSERT_EQUAL(0x06, frame[3]);
+    TEST_ASSERT_EQUAL(bit(HEALTH_TENSION_TIMEOUT) | bit(HEALTH_TEMPERATURA_SIN_DATOS), frame[4]);
+}
+
+/**
+    Un promedio fuera del rango de un int16 se satura a ±327,67.
+*/
+void test_saturation() {
+    load<FakeVoltage>(0, 400.00);
+    load<FakeVoltage>(1, -400.00);
+    uint8_t frame[LORA_FRAME_MAX_SIZE];
+    composeLoRaFrame(false, false, "S", frame);
+    TEST_ASSERT_EQUAL(32767, (int16_t)(frame[7] | (frame[8] << 8)));
+    TEST_ASSERT_EQUAL(-32767, (int16_t)(frame[9] | (frame[10] << 8)));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_documented_example);
+    RUN_TEST(test_all_channels);
+    RUN_TEST(test_missing_channels_and_emergency);
+    RUN_TEST(test_saturation);
+    return UNITY_END();
+}
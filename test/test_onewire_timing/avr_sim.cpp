@@ -0,0 +1,193 @@
+/**
+    Implementación de la simulación del ATmega328 y del bus 1-Wire (ver avr_sim.h).
+    El esclavo responde a un pulso de reset de al menos 480 us con un pulso de presencia que sólo
+    ocupa la ventana garantizada por la hoja de datos (de 60 a 75 us después de soltar el bus):
+    una muestra fuera de esa ventana no lo ve.
+    @file avr_sim.cpp
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+#include "avr_sim.h"
+#include "../../lib/OneWire-2.3.6/util/OneWire_slot_timing.h"
+
+Timer2Counter TCNT2;
+Timer2Flags TIFR2;
+Timer2Control GTCCR;
+uint8_t TCCR2A, TCCR2B, OCR2B, TIMSK2;
+
+uint64_t simCycles;
+uint64_t simLatency;
+SimRun simRun;
+
+static bool interruptsEnabled;
+static uint64_t disabledSince;
+static uint64_t timer2Base;
+static uint8_t timer2Start;
+static bool masterOutput;
+static uint8_t masterLevel;
+static uint64_t lowSince;
+static uint64_t releasedAt;
+static uint64_t presenceFrom;
+static uint64_t presenceTo;
+
+/**
+    timer2Value() devuelve la cuenta de Timer2 en el ciclo actual.
+*/
+static uint8_t timer2Value() {
+    return (uint8_t)(timer2Start + (simCycles - timer2Base) / OW_TIMER_PRESCALER);
+}
+
+/**
+    tick() avanza el reloj un ciclo y marca el compare B cuando Timer2 llega a OCR2B.
+*/
+static void tick() {
+    simCycles++;
+    if ((TCCR2B & 0x07) && (simCycles - timer2Base) % OW_TIMER_PRESCALER == 0 && timer2Value() == OCR2B) {
+        TIFR2.value |= _BV(OCF2B);
+    }
+}
+
+/**
+    record() registra una ventana con interrupciones deshabilitadas por la librería.
+*/
+static void record(uint64_t since) {
+    if (simCycles - since > simRun.longestDisabled) {
+        simRun.longestDisabled = simCycles - since;
+    }
+}
+
+/**
+    dispatch() atiende el compare B pendiente: primero corren durante simLatency ciclos las
+    rutinas del firmware que lo demoran, luego la de la librería.
+*/
+static void dispatch() {
+    TIFR2.value &= ~_BV(OCF2B);
+    interruptsEnabled = false;
+    for (uint64_t i = 0; i < simLatency; i++) {
+        tick();
+    }
+    uint64_t start = simCycles;
+    for (uint8_t i = 0; i < SIM_ENTRY_CYCLES; i++) {
+        tick();
+    }
+    simTimer2CompB();
+    for (uint8_t i = 0; i < SIM_EXIT_CYCLES; i++) {
+        tick();
+    }
+    record(start);
+    interruptsEnabled = true;
+}
+
+/**
+    pending() indica si el compare B puede atenderse ahora.
+*/
+static bool pending() {
+    return interruptsEnabled && (TIMSK2 & _BV(OCIE2B)) && (TIFR2.value & _BV(OCF2B));
+}
+
+Timer2Counter::operator uint8_t() {
+    simAdvance(SIM_SPIN_CYCLES);
+    return timer2Value();
+}
+
+Timer2Counter& Timer2Counter::operator=(uint8_t value) {
+    timer2Start = value;
+    timer2Base = simCycles;
+    return *this;
+}
+
+Timer2Control& Timer2Control::operator=(uint8_t bits) {
+    if (bits & _BV(PSRASY)) {
+        timer2Start = timer2Value();
+        timer2Base = simCycles;
+    }
+    return *this;
+}
+
+void simReset(uint64_t latency) {
+    simCycles = 0;
+    simLatency = latency;
+    simRun.longestDisabled = 0;
+    simRun.lastLow = 0;
+    simRun.lastSample = 0;
+    interruptsEnabled = true;
+    TCCR2A = 0;
+    TCCR2B = 0;
+    OCR2B = 0;
+    TIMSK2 = 0;
+    TIFR2.value = 0;
+    timer2Start = 0;
+    timer2Base = 0;
+    masterOutput = false;
+    masterLevel = LOW;
+    releasedAt = 0;
+    presenceFrom = 0;
+    presenceTo = 0;
+}
+
+void simAdvance(uint64_t cycles) {
+    for (uint64_t i = 0; i < cycles; i++) {
+        tick();
+        if (pending()) {
+            dispatch();
+        }
+    }
+}
+
+void simCli() {
+    simAdvance(1);
+    if (interruptsEnabled) {
+        interruptsEnabled = false;
+        disabledSince = simCycles;
+    }
+}
+
+void simSei() {
+    if (!interruptsEnabled) {
+        record(disabledSince);
+        interruptsEnabled = true;
+    }
+    simAdvance(1);
+}
+
+/**
+    drive() aplica un cambio del maestro sobre el bus. Al soltarlo tras un pulso de reset, el
+    esclavo agenda su pulso de presencia.
+*/
+static void drive(bool output, uint8_t level) {
+    bool wasLow = masterOutput && masterLevel == LOW;
+    masterOutput = output;
+    masterLevel = level;
+    bool isLow = masterOutput && masterLevel == LOW;
+    if (!wasLow && isLow) {
+        lowSince = simCycles;
+    } else if (wasLow && !isLow) {
+        simRun.lastLow = simCycles - lowSince;
+        releasedAt = simCycles;
+        if (simRun.lastLow >= (uint64_t)OW_RESET_LOW_US * CYCLES_PER_US) {
+            presenceFrom = simCycles + OW_PRESENCE_MIN_US * CYCLES_PER_US;
+            presenceTo = simCycles + OW_PRESENCE_MAX_US * CYCLES_PER_US;
+        }
+    }
+}
+
+void simPinMode(uint8_t, uint8_t mode) {
+    simAdvance(SIM_IO_CYCLES);
+    drive(mode == OUTPUT, masterLevel);
+}
+
+void simDigitalWrite(uint8_t, uint8_t value) {
+    simAdvance(SIM_IO_CYCLES);
+    drive(masterOutput, value);
+}
+
+int simDigitalRead(uint8_t) {
+    simAdvance(SIM_IO_CYCLES);
+    simRun.lastSample = simCycles - releasedAt;
+    if (masterOutput && masterLevel == LOW) {
+        return LOW;
+    }
+    return (simCycles >= presenceFrom && simCycles <= presenceTo) ? LOW : HIGH;
+}
@@ -0,0 +1,108 @@
+/**
+    Simulación mínima de un ATmega328 a 16 MHz para correr OneWire.cpp en el host: un reloj
+    virtual en ciclos, el flag global de interrupciones, Timer2 con su compare B y un bus 1-Wire
+    con un esclavo. Se incluye antes de OneWire.cpp: las llamadas de la librería al core
+    (delayMicroseconds(), pinMode(), etc.) se reemplazan por macros que avanzan el reloj.
+    @file avr_sim.h
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+#ifndef AVR_SIM_H
+#define AVR_SIM_H
+
+#include <Arduino.h>
+
+// Sin registros de puerto en el host, la librería usa pinMode(), digitalRead() y digitalWrite(),
+// que la simulación intercepta (de ahí el aviso "Fallback mode" al compilar).
+#pragma GCC diagnostic ignored "-Wunused-variable"
+
+#define F_CPU 16000000UL
+#define ARDUINO 10813
+#define CYCLES_PER_US (F_CPU / 1000000UL)
+#define OW_PIN 4 // Pin del bus 1-Wire.
+
+// Costo de cada operación (en ciclos).
+#define SIM_IO_CYCLES 2     // sbi / cbi / sbic sobre un puerto.
+#define SIM_SPIN_CYCLES 6   // Una vuelta de un bucle de espera.
+#define SIM_ENTRY_CYCLES 32 // Respuesta a la interrupción, salto al vector y prólogo.
+#define SIM_EXIT_CYCLES 24  // Epílogo y reti.
+
+/**
+    Timer2Counter emula TCNT2: cuenta a clk/32 desde la última escritura o reinicio del prescaler.
+    Cada lectura consume SIM_SPIN_CYCLES, como la vuelta del bucle que la contiene.
+*/
+struct Timer2Counter {
+    operator uint8_t();
+    Timer2Counter& operator=(uint8_t value);
+};
+
+/**
+    Timer2Flags emula TIFR2: un 1 escrito en un bit lo borra.
+*/
+struct Timer2Flags {
+    uint8_t value;
+    operator uint8_t() { return value; }
+    Timer2Flags& operator=(uint8_t bits) { value &= ~bits; return *this; }
+};
+
+/**
+    Timer2Control emula GTCCR: escribir PSRASY reinicia el prescaler de Timer2.
+*/
+struct Timer2Control {
+    Timer2Control& operator=(uint8_t bits);
+};
+
+extern Timer2Counter TCNT2;
+extern Timer2Flags TIFR2;
+extern Timer2Control GTCCR;
+extern uint8_t TCCR2A, TCCR2B, OCR2B, TIMSK2;
+
+#define _BV(b) (1 << (b))
+#define CS20 0
+#define CS21 1
+#define OCF2B 2
+#define OCIE2B 2
+#define PSRASY 1
+#define ISR(vector) void vector(void)
+#define TIMER2_COMPB_vect simTimer2CompB
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+
+/**
+    SimRun resume lo medido desde simReset(), en ciclos: la ventana más larga con interrupciones
+    deshabilitadas por la librería (incluida su propia rutina de interrupción), la duración de la
+    última fase baja impuesta por el maestro y la demora de la última muestra del bus desde que
+    el maestro lo soltó.
+*/
+struct SimRun {
+    uint64_t longestDisabled;
+    uint64_t lastLow;
+    uint64_t lastSample;
+};
+
+extern uint64_t simCycles;
+extern uint64_t simLatency;
+extern SimRun simRun;
+
+void simReset(uint64_t latency);
+void simAdvance(uint64_t cycles);
+void simCli();
+void simSei();
+void simPinMode(uint8_t pin, uint8_t mode);
+void simDigitalWrite(uint8_t pin, uint8_t value);
+int simDigitalRead(uint8_t pin);
+void simTimer2CompB(void);
+
+#undef noInterrupts
+#undef interrupts
+#define noInterrupts() simCli()
+#define interrupts() simSei()
+#define delayMicroseconds(us) simAdvance((uint64_t)(us) * CYCLES_PER_US)
+#define yield() simAdvance(SIM_SPIN_CYCLES)
+#define pinMode(pin, mode) simPinMode(pin, mode)
+#define digitalWrite(pin, value) simDigitalWrite(pin, value)
+#define digitalRead(pin) simDigitalRead(pin)
+
+#endif
@@ -0,0 +1,29 @@
+/**
+    OneWire 2.3.6 sin ONEWIRE_TIMER_SLOTS (todo el slot con interrupciones deshabilitadas),
+    compilada como OneWireLegacy sobre la misma simulación, para comparar ambas versiones.
+    @file legacy.cpp
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+#define ONEWIRE_TIMER_SLOTS 0
+#define OneWire OneWireLegacy
+#include "avr_sim.h"
+#include "../../lib/OneWire-2.3.6/OneWire.cpp"
+
+/**
+    legacySlots() corre con la versión original un reset, la escritura de un byte con ceros y
+    unos, y la lectura de un byte.
+    @param latency Demora de las demás interrupciones (en ciclos).
+    @param present Devuelve el resultado del reset.
+    @return Lo medido en la simulación.
+*/
+SimRun legacySlots(uint64_t latency, uint8_t& present) {
+    simReset(latency);
+    OneWireLegacy ow(OW_PIN);
+    present = ow.reset();
+    ow.write(0x0F);
+    ow.read();
+    return simRun;
+}
@@ -0,0 +1,157 @@
+/**
+    Tests de temporización de los slots OneWire temporizados por Timer2 (ONEWIRE_TIMER_SLOTS).
+    OneWire.cpp corre sobre una simulación de un ATmega328 a 16 MHz (ver avr_sim.h), que mide la
+    ventana más larga con interrupciones deshabilitadas, antes (OneWire 2.3.6 original, ver
+    legacy.cpp) y después, y los instantes de las muestras y de las fases bajas del bus. La demora
+    que las demás interrupciones del firmware imponen a la de Timer2 se inyecta en la simulación.
+    @file test_main.cpp
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+#define ONEWIRE_TIMER_SLOTS 1
+#include "avr_sim.h"
+#include "../../lib/OneWire-2.3.6/OneWire.cpp"
+#include <unity.h>
+
+#define US(cycles) ((double)(cycles) / CYCLES_PER_US)
+
+// Tiempo máximo de cada rutina de interrupción del firmware, de la entrada al reti (en ciclos).
+// Es una estimación a partir de su código (prólogo y epílogo con los registros que usa, y el
+// cuerpo más largo), no una medición: sólo se usa para verificar ONEWIRE_PRESENCE_LATENCY_US.
+#define ADC_CYCLES 288    // handleADC() en una ventana de tensión, o expansionSample() fuera de ella.
+#define PCINT2_CYCLES 288 // millis() y dos digitalRead() (puerta y antipánico).
+#define INT0_CYCLES 96    // DIO0 de LoRa: millis() y el flag pendiente.
+#define TIMER0_CYCLES 80  // Overflow de Timer0 (millis()).
+
+/**
+    IsrCost describe una interrupción del firmware: su vector (a menor vector, mayor prioridad)
+    y su duración máxima estimada en ciclos.
+*/
+struct IsrCost {
+    uint8_t vector;
+    unsigned int cycles;
+};
+
+const IsrCost isrCosts[] = {
+    {1, INT0_CYCLES},
+    {5, PCINT2_CYCLES},
+    {16, TIMER0_CYCLES},
+    {21, ADC_CYCLES}
+};
+
+#define TIMER2_COMPB_VECTOR 8
+#define ISR_COUNT (sizeof(isrCosts) / sizeof(isrCosts[0]))
+#define LATENCY_MAX ((uint64_t)ONEWIRE_PRESENCE_LATENCY_US * CYCLES_PER_US - SIM_ENTRY_CYCLES)
+#define LATENCY_STEP 4 // Paso de la demora inyectada (en ciclos): recorre todas las fases de Timer2.
+
+SimRun legacySlots(uint64_t latency, uint8_t& present);
+
+/**
+    estimatedLatency() devuelve la peor demora estimada de la interrupción de Timer2: una rutina
+    cualquiera que ya esté corriendo (el AVR no anida interrupciones), más todas las de mayor
+    prioridad que queden pendientes, más la entrada a la propia rutina.
+    @return Latencia (en ciclos).
+*/
+unsigned int estimatedLatency() {
+    unsigned int worst = 0;
+    for (uint8_t running = 0; running < ISR_COUNT; running++) {
+        unsigned int cycles = isrCosts[running].cycles;
+        for (uint8_t i = 0; i < ISR_COUNT; i++) {
+            if (i != running && isrCosts[i].vector < TIMER2_COMPB_VECTOR) {
+                cycles += isrCosts[i].cycles;
+            }
+        }
+        worst = max(worst, cycles);
+    }
+    return worst + SIM_ENTRY_CYCLES;
+}
+
+/**
+    timerSlots() corre con ONEWIRE_TIMER_SLOTS lo mismo que legacySlots().
+*/
+SimRun timerSlots(uint64_t latency, uint8_t& present) {
+    simReset(latency);
+    OneWire ow(OW_PIN);
+    present = ow.reset();
+    ow.write(0x0F);
+    ow.read();
+    return simRun;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+/**
+    Las interrupciones del firmware, según su costo estimado, no demoran la muestra de presencia
+    más de lo que tolera la librería.
+*/
+void test_latency_budget(void) {
+    TEST_ASSERT_TRUE(US(estimatedLatency()) <= ONEWIRE_PRESENCE_LATENCY_US);
+}
+
+/**
+    Con cualquier demora hasta ONEWIRE_PRESENCE_LATENCY_US (y, con ella, cualquier fase de
+    Timer2 al soltar el bus), reset() toma la muestra dentro de la ventana garantizada del pulso
+    de presencia (60 a 75 us) y detecta al esclavo.
+*/
+void test_presence_sample_within_window(void) {
+    for (uint64_t latency = 0; latency <= LATENCY_MAX; latency += LATENCY_STEP) {
+        simReset(latency);
+        OneWire ow(OW_PIN);
+        TEST_ASSERT_EQUAL(1, ow.reset());
+        TEST_ASSERT_TRUE(US(simRun.lastSample) >= OW_PRESENCE_MIN_US);
+        TEST_ASSERT_TRUE(US(simRun.lastSample) <= OW_PRESENCE_MAX_US);
+        TEST_ASSERT_TRUE(US(simRun.lastLow) >= OW_RESET_LOW_US);
+    }
+}
+
+/**
+    La fase baja de un 0 que termina Timer2 queda dentro de tLOW0 (60 a 120 us) con cualquier
+    demora hasta ONEWIRE_PRESENCE_LATENCY_US.
+*/
+void test_write0_low_phase_within_spec(void) {
+    for (uint64_t latency = 0; latency <= LATENCY_MAX; latency += LATENCY_STEP) {
+        simReset(latency);
+        OneWire ow(OW_PIN);
+        ow.write_bit(0);
+        TEST_ASSERT_TRUE(US(simRun.lastLow) >= 60);
+        TEST_ASSERT_TRUE(US(simRun.lastLow) <= 120);
+    }
+}
+
+/**
+    La ventana más larga con interrupciones deshabilitadas, medida sobre un reset, un byte
+    escrito y uno leído: la versión original retiene las interrupciones durante toda la espera
+    de la muestra de presencia (70 us); con Timer2, a lo sumo la rutina de interrupción que
+    espera hasta esa muestra (unos 34 us, con su entrada y su salida).
+*/
+void test_interrupt_window_before_after(void) {
+    uint64_t before = 0;
+    uint64_t after = 0;
+    for (uint64_t latency = 0; latency <= LATENCY_MAX; latency += LATENCY_STEP) {
+        uint8_t present;
+        before = max(before, legacySlots(latency, present).longestDisabled);
+        TEST_ASSERT_EQUAL(1, present);
+        after = max(after, timerSlots(latency, present).longestDisabled);
+        TEST_ASSERT_EQUAL(1, present);
+    }
+    TEST_ASSERT_TRUE(US(before) >= 70);
+    TEST_ASSERT_TRUE(US(after) <= 35);
+    // Una ventana más corta que un período del ADC (500 us a 2 kHz) no hace perder conversiones,
+    // pero sí demora PCINT2 y DIO0: el reset original los retenía más del doble.
+    TEST_ASSERT_TRUE(after < before / 2);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_latency_budget);
+    RUN_TEST(test_presence_sample_within_window);
+    RUN_TEST(test_write0_low_phase_within_spec);
+    RUN_TEST(test_interrupt_window_before_after);
+    return UNITY_END();
+}
@@ -0,0 +1,128 @@
+/**
+    Tests del filtro de mediana del registro de sensores (sensor_registry.h), con un driver falso
+    que entrega una secuencia fija de muestras en un único canal.
+    @file test_main.cpp
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "constants.h"
+#include "timing_helpers.h"
+#include "decimal_helpers.h"
+#include "array_helpers.h"
+#include "sensor_registry.h"
+
+#define OUTLIER 10880 // 85 °C de reset del DS18B20 (en 1/128 °C).
+
+/**
+    ScriptedSensor es un driver de un canal cuyas mediciones salen, en orden, de script[].
+*/
+struct ScriptedSensor {
+    typedef int16_t Sample;
+    static const uint8_t CHANNELS = 1;
+    static const int PERIOD = 1;
+    static const int PHASE = 0;
+    static const uint8_t HEALTH_EMPTY = 0;
+    static const int16_t* script;
+    static uint8_t next;
+
+    static bool read(Sample out[], uint8_t& valid) {
+        out[0] = script[next++];
+        valid = 0x01;
+        return true;
+    }
+
+    static int32_t hundredths(Sample value) {
+        return value;
+    }
+
+    static bool reported(uint8_t channel) {
+        return true;
+    }
+
+    static void name(uint8_t channel, String& rtn) {
+        rtn += "x";
+    }
+};
+
+const int16_t* ScriptedSensor::script;
+uint8_t ScriptedSensor::next;
+
+typedef SensorRegistry<ScriptedSensor> Registry;
+typedef SensorSeries<ScriptedSensor> Series;
+
+/**
+    feed() mide count muestras de script, vacía las series y devuelve la suma de las acumuladas.
+*/
+int32_t feed(const int16_t* script, uint8_t count, uint16_t& accumulated) {
+    ScriptedSensor::script = script;
+    ScriptedSensor::next = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        Series::requested = true;
+        Registry::poll();
+    }
+    int32_t sum = Series::sum[0];
+    accumulated = Series::count[0];
+    Registry::clear();
+    return sum;
+}
+
+void setUp(void) {
+    Series::restartFilter();
+    Registry::clear();
+}
+
+void tearDown(void) {
+}
+
+/**
+    Un valor fuera de rango en la primera muestra no llega a las series: las dos primeras sólo
+    completan la historia del filtro.
+*/
+void test_first_sample_outlier_is_filtered() {
+    const int16_t script[] = {OUTLIER, 2230, 2231, 2232};
+    uint16_t accumulated;
+    int32_t sum = feed(script, 4, accumulated);
+    TEST_ASSERT_EQUAL(2, accumulated);
+    TEST_ASSERT_EQUAL(2231 + 2231, sum);
+}
+
+/**
+    Lo mismo con el valor fuera de rango en la segunda muestra.
+*/
+void test_second_sample_outlier_is_filtered() {
+    const int16_t script[] = {2230, OUTLIER, 2231, 2232};
+    uint16_t accumulated;
+    int32_t sum = feed(script, 4, accumulated);
+    TEST_ASSERT_EQUAL(2, accumulated);
+    TEST_ASSERT_EQUAL(2231 + 2232, sum);
+}
+
+/**
+    La historia sobrevive a clear(), pero restartFilter() la olvida: tras reiniciarlo, un valor
+    fuera de rango en la primera muestra tampoco pasa.
+*/
+void test_restart_filter() {
+    const int16_t first[] = {2230, 2230, 2230};
+    const int16_t second[] = {OUTLIER, 1000, 1001};
+    uint16_t accumulated;
+    feed(first, 3, accumulated);
+    TEST_ASSERT_EQUAL(1, accumulated);
+    feed(first, 1, accumulated);
+    TEST_ASSERT_EQUAL(1, accumulated);
+    Series::restartFilter();
+    int32_t sum = feed(second, 3, accumulated);
+    TEST_ASSERT_EQUAL(1, accumulated);
+    TEST_ASSERT_EQUAL(1001, sum);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_first_sample_outlier_is_filtered);
+    RUN_TEST(test_second_sample_outlier_is_filtered);
+    RUN_TEST(test_restart_filter);
+    return UNITY_END();
+}
@@ -0,0 +1,174 @@
+/**
+    Tests del agendado por slots (tdma.h) con relojes de nodo adelantados y atrasados.
+    Se simula el tiempo real en pasos de 1 ms; millis() del nodo avanza con su propia deriva.
+    @file test_main.cpp
+    @author Franco Abosso
+    @author Julio Donadello
+    @version 1.0 29/03/2021
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "constants.h"
+
+#define BEACON_AIRTIME 30 // Tiempo en el aire del beacon (en ms).
+#define BEACON_LENGTH 10  // Longitud del beacon (en bytes).
+
+/**
+    FakeLoRa reemplaza al módulo: tdma.h sólo le pide el tiempo en el aire del beacon.
+*/
+struct FakeLoRa {
+    unsigned long timeOnAir(int) {
+        return BEACON_AIRTIME;
+    }
+} LoRa;
+
+bool tdmaSynced;
+unsigned long tdmaFrameStart;
+long tdmaRemainder;
+long tdmaDrift;
+uint32_t tdmaFrame;
+uint32_t tdmaUplinkFrame;
+uint16_t tdmaFramesSinceBeacon;
+
+#include "timing_helpers.h"
+#include "tdma.h"
+
+#define IDEAL_OFFSET (LORA_TDMA_SLOT * LORA_TDMA_SLOT_MS + LORA_TDMA_GUARD) // Inicio ideal del reporte en la trama (en ms).
+
+/**
+    TdmaRun resume una simulación: reportes hechos en sincronización, reportes fuera de la demora
+    máxima, y el peor desfasaje respecto del inicio ideal del slot (en ms de tiempo real) desde la
+    trama settleFrames en adelante.
+*/
+struct TdmaRun {
+    int uplinks;
+    int lateUplinks;
+    double worstError;
+};
+
+/**
+    simulate() corre frames tramas del concentrador. El beacon se transmite al comienzo de cada
+    trama, pero el nodo sólo recibe uno de cada beaconEvery (y ninguno desde lostFrom).
+    @param skew Relación entre el millis() del nodo y el tiempo real (1.003: 0,3% adelantado).
+*/
+TdmaRun simulate(double skew, int frames, int beaconEvery, int settleFrames, int lostFrom = -1) {
+    TdmaRun run = {0, 0, 0};
+    const double firstFrame = 1000;
+    int beacons = 0;
+    for (double trueMs = 0; trueMs < firstFrame + (double)frames * LORA_TDMA_FRAME_MS; trueMs += 1) {
+        mockMillis = (unsigned long)(trueMs * skew);
+        double frameStart = firstFrame + (double)beacons * LORA_TDMA_FRAME_MS;
+        if (trueMs >= frameStart + BEACON_AIRTIME) {
+            if (beacons % beaconEvery == 0 && (lostFrom < 0 || beacons < lostFrom)) {
+                tdmaBeacon(millis(), BEACON_LENGTH);
+            }
+            beacons++;
+        }
+        bool synced = tdmaSynced;
+        if (tdmaUplinkDue() && synced) {
+            run.uplinks++;
+            int frame = (int)((trueMs - firstFrame) / LORA_TDMA_FRAME_MS);
+            double error = fabs(fmod(trueMs - firstFrame, LORA_TDMA_FRAME_MS) - IDEAL_OFFSET);
+            if (frame >= settleFrames && error > run.worstError) {
+                run.worstError = error;
+            }
+            if (error >= LORA_TDMA_WINDOW) {
+                run.lateUplinks++;
+            }
+        }
+    }
+    return run;
+}
+
+void setUp(void) {
+    mockMillis = 0;
+    tdmaSynced = false;
+    tdmaFrameStart = 0;
+    tdmaRemainder = 0;
+    tdmaDrift = 0;
+    tdmaFrame = 0;
+    tdmaUplinkFrame = 0;
+    tdmaFramesSinceBeacon = 0;
+}
+
+void tearDown(void) {
+}
+
+/**
+    Sin beacons, el nodo reporta cada LORA_TIMEOUT segundos (ALOHA).
+*/
+void test_unsynced_reports_every_timeout(void) {
+    int uplinks = 0;
+    for (mockMillis = 1; mockMillis <= 10 * LORA_TDMA_FRAME_MS; mockMillis++) {
+        uplinks += tdmaUplinkDue();
+    }
+    TEST_ASSERT_FALSE(tdmaSynced);
+    TEST_ASSERT_EQUAL(10, uplinks);
+}
+
+/**
+    Con un beacon por trama y el reloj exacto, cada reporte sale al comienzo de su slot.
+*/
+void test_synced_uplink_starts_at_slot(void) {
+    TdmaRun run = simulate(1.0, 10, 1, 1);
+    TEST_ASSERT_TRUE(tdmaSynced);
+    TEST_ASSERT_EQUAL(10, run.uplinks);
+    TEST_ASSERT_EQUAL(0, run.lateUplinks);
+    TEST_ASSERT_LESS_OR_EQUAL(1, run.worstError);
+}
+
+/**
+    Con un beacon cada 3 tramas, la deriva estimada mantiene el reporte en el slot aunque el
+    oscilador del nodo esté 0,3% adelantado (60 ms por trama); tras 30 tramas, con un error
+    menor a 2 ms.
+*/
+void test_drift_fast_clock(void) {
+    TdmaRun run = simulate(1.003, 45, 3, 30);
+    TEST_ASSERT_EQUAL(45, run.uplinks);
+    TEST_ASSERT_EQUAL(0, run.lateUplinks);
+    TEST_ASSERT_LESS_OR_EQUAL(2, run.worstError);
+}
+
+/**
+    Ídem, con el oscilador del nodo 0,4% atrasado.
+*/
+void test_drift_slow_clock(void) {
+    TdmaRun run = simulate(0.996, 45, 3, 30);
+    TEST_ASSERT_EQUAL(45, run.uplinks);
+    TEST_ASSERT_EQUAL(0, run.lateUplinks);
+    TEST_ASSERT_LESS_OR_EQUAL(2, run.worstError);
+}
+
+/**
+    Luego de LORA_TDMA_HOLDOVER tramas sin beacon, el nodo pierde la sincronización.
+*/
+void test_holdover_loses_sync(void) {
+    simulate(1.003, LORA_TDMA_HOLDOVER + 5, 1, 0, 3);
+    TEST_ASSERT_FALSE(tdmaSynced);
+}
+
+/**
+    El reporte debe caber en el slot: la guarda más la demora máxima de inicio dejan margen para
+    el paquete. Por eso, con las tramas sincronizadas, LoRaSend() no escucha el canal: la espera
+    aleatoria de LBT (hasta LORA_LBT_SLOT * 2^n ms en el n-ésimo intento) no cabe en el slot.
+*/
+void test_slot_leaves_room_for_the_packet(void) {
+    TEST_ASSERT_LESS_THAN(LORA_TDMA_SLOT_MS, LORA_TDMA_GUARD + LORA_TDMA_WINDOW);
+    unsigned long worstBackoff = 0;
+    for (int attempt = 1; attempt <= LORA_LBT_ATTEMPTS; attempt++) {
+        worstBackoff += (unsigned long)LORA_LBT_SLOT << attempt;
+    }
+    TEST_ASSERT_GREATER_THAN(LORA_TDMA_SLOT_MS, worstBackoff);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_unsynced_reports_every_timeout);
+    RUN_TEST(test_synced_uplink_starts_at_slot);
+    RUN_TEST(test_drift_fast_clock);
+    RUN_TEST(test_drift_slow_clock);
+    RUN_TEST(test_holdover_loses_sync);
+    RUN_TEST(test_slot_leaves_room_for_the_packet);
+    return UNITY_END();
+}
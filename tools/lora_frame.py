@@ -0,0 +1,69 @@
+"""Decodificador de la trama binaria LoRa (ver docs/Trama binaria LoRa.md).
+
+Uso:
+    python3 lora_frame.py [--probes N] [--analog NOMBRES] <bytes en hexadecimal>
+
+Por ejemplo:
+    python3 lora_frame.py 01 19 27 00 00 1F 00 E4 57 89 13 8D 00 03 00 92 09
+
+El bit de cada canal depende de la configuración del nodo: TEMPERATURA_PROBES y
+EXPANSION_NOMBRES (ver constants.h) deben coincidir con --probes y --analog.
+"""
+
+import argparse
+import struct
+
+FRAME_VERSION = 1
+HEADER_SIZE = 7
+VOLTAGE_CHANNELS = ["voltage", "frequency", "crest", "distortion"]
+ANALOG_CHANNELS = ["analog3", "analog4", "analog5", "analog6", "analog7"]
+STATUS = "SLF"
+
+
+def channels(probes=3, analog=ANALOG_CHANNELS):
+    """Devuelve los nombres de los canales en el orden de sus bits (el del registro de sensores)."""
+    temperatures = ["temperature"] + ["temperature%d" % (n + 1) for n in range(1, probes)]
+    return VOLTAGE_CHANNELS + temperatures + list(analog)
+
+
+def decode(frame, probes=3, analog=ANALOG_CHANNELS):
+    """Decodifica una trama binaria en un diccionario con los campos del payload de texto."""
+    if frame[:1] == b"<":
+        raise ValueError("payload de texto")
+    version, device_id, flags, health, present = struct.unpack_from("<BHBBH", frame)
+    if version != FRAME_VERSION:
+        raise ValueError("versión de trama desconocida: %d" % version)
+    names = channels(probes, analog)
+    if present >> len(names):
+        raise ValueError("canales presentes 0x%04X fuera del mapa de %d canales" % (present, len(names)))
+    report = {
+        "id": device_id,
+        "status": STATUS[flags & 0x03],
+        "emergency": bool(flags & 0x04),
+        "door": bool(flags & 0x08),
+        "health": health,
+    }
+    offset = HEADER_SIZE
+    for bit, name in enumerate(names):
+        if present & (1 << bit):
+            (value,) = struct.unpack_from("<h", frame, offset)
+            report[name] = value / 100
+            offset += 2
+    if offset != len(frame):
+        raise ValueError("la trama mide %d bytes y los canales presentes, %d" % (len(frame), offset))
+    return report
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decodifica una trama binaria LoRa.")
+    parser.add_argument("--probes", type=int, default=3, help="TEMPERATURA_PROBES del nodo")
+    parser.add_argument("--analog", default=",".join(ANALOG_CHANNELS),
+                        help="EXPANSION_NOMBRES del nodo, separados por comas")
+    parser.add_argument("hex", nargs="+", help="bytes de la trama en hexadecimal")
+    args = parser.parse_args()
+    frame = bytes.fromhex("".join(args.hex))
+    print(decode(frame, args.probes, args.analog.split(",")))
+
+
+if __name__ == "__main__":
+    main()